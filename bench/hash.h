@@ -0,0 +1,58 @@
+#ifndef PHF_BENCH_HASH_H
+#define PHF_BENCH_HASH_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "phf/bits.h"
+#include "phf/fragments.h"
+
+namespace bench {
+
+//
+// A simple seeded hash for the benchmark key types. It processes
+// strings 8 bytes at a time and finishes with the splitmix64 mixer.
+//
+struct hash
+{
+	using result_type = std::uint64_t;
+
+	static constexpr std::uint64_t multiplier = UINT64_C(0x9E3779B97F4A7C15);
+
+	result_type operator()(std::uint64_t key, std::uint64_t seed) const
+	{
+		return phf::bits::mix(key ^ (seed * multiplier));
+	}
+
+	result_type operator()(const std::string &key, std::uint64_t seed) const
+	{
+		std::uint64_t h = seed ^ (key.size() * multiplier);
+		const char *p = key.data();
+		std::size_t n = key.size();
+		for (; n >= 8; n -= 8, p += 8) {
+			std::uint64_t word;
+			std::memcpy(&word, p, 8);
+			h = phf::bits::mix(h ^ word) * multiplier;
+		}
+		if (n) {
+			std::uint64_t word = 0;
+			std::memcpy(&word, p, n);
+			h = phf::bits::mix(h ^ word) * multiplier;
+		}
+		return phf::bits::mix(h);
+	}
+
+	// The same as for the contiguous string.
+	result_type operator()(const phf::fragments &key, std::uint64_t seed) const
+	{
+		std::uint64_t h = seed ^ (key.size() * multiplier);
+		key.for_each_word(
+			[&h](std::uint64_t word) { h = phf::bits::mix(h ^ word) * multiplier; });
+		return phf::bits::mix(h);
+	}
+};
+
+} // namespace bench
+
+#endif // PHF_BENCH_HASH_H
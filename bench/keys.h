@@ -0,0 +1,208 @@
+#ifndef PHF_BENCH_KEYS_H
+#define PHF_BENCH_KEYS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "phf/rng.h"
+
+namespace bench {
+
+//
+// A generated key set. The negative keys are guaranteed to be absent
+// from the positive ones.
+//
+template <typename Key>
+struct key_set
+{
+	std::vector<Key> positive;
+	std::vector<Key> negative;
+};
+
+//
+// Integer keys: 0, 1, 2, ...
+//
+static inline void
+generate_sequential(key_set<std::uint64_t> &keys, std::size_t n, rng::rng128 &)
+{
+	for (std::size_t i = 0; i < n; i++) {
+		keys.positive.push_back(i);
+		keys.negative.push_back(n + i);
+	}
+}
+
+//
+// Random integer keys.
+//
+static inline void
+generate_random(key_set<std::uint64_t> &keys, std::size_t n, rng::rng128 &rng)
+{
+	std::unordered_set<std::uint64_t> seen;
+	seen.reserve(2 * n);
+	while (keys.positive.size() < n) {
+		auto key = rng();
+		if (seen.insert(key).second)
+			keys.positive.push_back(key);
+	}
+	while (keys.negative.size() < n) {
+		auto key = rng();
+		if (seen.insert(key).second)
+			keys.negative.push_back(key);
+	}
+}
+
+//
+// Adversarial integer keys: the low 32 bits are always zero so a weak
+// hash that only looks at the low bits produces the same value for all
+// of them.
+//
+static inline void
+generate_stride(key_set<std::uint64_t> &keys, std::size_t n, rng::rng128 &)
+{
+	for (std::size_t i = 0; i < n; i++) {
+		keys.positive.push_back(std::uint64_t{2 * i} << 32);
+		keys.negative.push_back(std::uint64_t{2 * i + 1} << 32);
+	}
+}
+
+static inline std::string
+random_label(rng::rng128 &rng, std::size_t min_size, std::size_t max_size)
+{
+	static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+	std::size_t size = min_size + rng() % (max_size - min_size + 1);
+	std::string label;
+	for (std::size_t i = 0; i < size; i++)
+		label.push_back(chars[rng() % (sizeof chars - 1)]);
+	return label;
+}
+
+template <typename Generator>
+void
+generate_unique(key_set<std::string> &keys, std::size_t n, Generator generator)
+{
+	std::unordered_set<std::string> seen;
+	seen.reserve(2 * n);
+	while (keys.positive.size() < n) {
+		auto key = generator();
+		if (seen.insert(key).second)
+			keys.positive.push_back(std::move(key));
+	}
+	while (keys.negative.size() < n) {
+		auto key = generator();
+		if (seen.insert(key).second)
+			keys.negative.push_back(std::move(key));
+	}
+}
+
+//
+// Short labels like DNS name labels or identifiers.
+//
+static inline void
+generate_label(key_set<std::string> &keys, std::size_t n, rng::rng128 &rng)
+{
+	generate_unique(keys, n, [&rng]() { return random_label(rng, 3, 12); });
+}
+
+//
+// Synthetic URLs.
+//
+static inline void
+generate_url(key_set<std::string> &keys, std::size_t n, rng::rng128 &rng)
+{
+	static const char *schemes[] = {"http://", "https://"};
+	static const char *tlds[] = {".com", ".org", ".net", ".co.uk", ".io", ".de"};
+	generate_unique(keys, n, [&rng]() {
+		std::string url = schemes[rng() % 2];
+		if (rng() % 2)
+			url += "www.";
+		url += random_label(rng, 4, 16);
+		url += tlds[rng() % 6];
+		for (auto depth = rng() % 4; depth; depth--)
+			url += "/" + random_label(rng, 2, 12);
+		if (rng() % 4 == 0)
+			url += "?id=" + std::to_string(rng() % 1000000);
+		return url;
+	});
+}
+
+//
+// Adversarial string keys: a long common prefix followed by a decimal
+// number so the keys differ only in a few trailing bytes.
+//
+static inline void
+generate_prefix(key_set<std::string> &keys, std::size_t n, rng::rng128 &)
+{
+	const std::string prefix(64, 'x');
+	for (std::size_t i = 0; i < n; i++) {
+		keys.positive.push_back(prefix + std::to_string(2 * i));
+		keys.negative.push_back(prefix + std::to_string(2 * i + 1));
+	}
+}
+
+//
+// Shuffle the keys so that the lookup order differs from the insertion
+// order.
+//
+template <typename Key>
+void
+shuffle(std::vector<Key> &keys, rng::rng128 &rng)
+{
+	for (std::size_t i = keys.size(); i > 1; i--)
+		std::swap(keys[i - 1], keys[rng() % i]);
+}
+
+static inline bool
+is_integer_kind(const std::string &kind)
+{
+	return kind == "seq" || kind == "random" || kind == "stride";
+}
+
+static inline bool
+is_string_kind(const std::string &kind)
+{
+	return kind == "url" || kind == "label" || kind == "prefix";
+}
+
+static inline void
+generate(key_set<std::uint64_t> &keys, const std::string &kind, std::size_t n,
+	 rng::rng128 &rng)
+{
+	keys.positive.reserve(n);
+	keys.negative.reserve(n);
+	if (kind == "seq")
+		generate_sequential(keys, n, rng);
+	else if (kind == "random")
+		generate_random(keys, n, rng);
+	else if (kind == "stride")
+		generate_stride(keys, n, rng);
+	else
+		throw std::invalid_argument("unknown integer key kind: " + kind);
+	shuffle(keys.positive, rng);
+	shuffle(keys.negative, rng);
+}
+
+static inline void
+generate(key_set<std::string> &keys, const std::string &kind, std::size_t n,
+	 rng::rng128 &rng)
+{
+	keys.positive.reserve(n);
+	keys.negative.reserve(n);
+	if (kind == "url")
+		generate_url(keys, n, rng);
+	else if (kind == "label")
+		generate_label(keys, n, rng);
+	else if (kind == "prefix")
+		generate_prefix(keys, n, rng);
+	else
+		throw std::invalid_argument("unknown string key kind: " + kind);
+	shuffle(keys.positive, rng);
+	shuffle(keys.negative, rng);
+}
+
+} // namespace bench
+
+#endif // PHF_BENCH_KEYS_H
@@ -0,0 +1,156 @@
+#ifndef PHF_BENCH_PERF_H
+#define PHF_BENCH_PERF_H
+
+#include <array>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace bench {
+
+//
+// Hardware performance counters based on the Linux perf_event_open()
+// system call. Each event is opened separately so if some of them are
+// not supported by the hardware or are not permitted, for instance in
+// a container, then the rest is still available. A missing event gives
+// a NaN value.
+//
+class perf_counters
+{
+public:
+	static constexpr std::size_t nevents = 6;
+
+	using values_type = std::array<double, nevents>;
+
+	perf_counters()
+	{
+		static const std::uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D
+			| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+			| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		static const std::uint64_t dtlb_read_miss = PERF_COUNT_HW_CACHE_DTLB
+			| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+			| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+		fds_[0] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		fds_[1] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		fds_[2] = open(PERF_TYPE_HW_CACHE, l1d_read_miss);
+		fds_[3] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+		fds_[4] = open(PERF_TYPE_HW_CACHE, dtlb_read_miss);
+		fds_[5] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+	}
+
+	~perf_counters()
+	{
+		for (auto fd : fds_) {
+			if (fd >= 0)
+				close(fd);
+		}
+	}
+
+	perf_counters(const perf_counters &) = delete;
+	perf_counters &operator=(const perf_counters &) = delete;
+
+	static const char *name(std::size_t index)
+	{
+		static const char *names[nevents] = {
+			"cycles",
+			"instructions",
+			"l1d_misses",
+			"llc_misses",
+			"dtlb_misses",
+			"branch_misses",
+		};
+		return names[index];
+	}
+
+	// The errno value of the first counter that failed to open or zero.
+	int error() const
+	{
+		return error_;
+	}
+
+	// Check if at least one counter is available.
+	bool available() const
+	{
+		for (auto fd : fds_) {
+			if (fd >= 0)
+				return true;
+		}
+		return false;
+	}
+
+	void start()
+	{
+		for (auto fd : fds_) {
+			if (fd >= 0) {
+				ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+	}
+
+	void stop()
+	{
+		for (auto fd : fds_) {
+			if (fd >= 0)
+				ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		}
+	}
+
+	// Get the counter values scaled to the given number of operations.
+	values_type values(double nops) const
+	{
+		values_type values;
+		for (std::size_t i = 0; i < nevents; i++)
+			values[i] = read(fds_[i]) / nops;
+		return values;
+	}
+
+private:
+	int open(std::uint32_t type, std::uint64_t config)
+	{
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof attr);
+		attr.size = sizeof attr;
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		int fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if (fd < 0 && error_ == 0)
+			error_ = errno;
+		return fd;
+	}
+
+	// Read a counter value. If the counters were multiplexed then the
+	// value is extrapolated from the time the counter was running.
+	static double read(int fd)
+	{
+		static const double nan = std::numeric_limits<double>::quiet_NaN();
+		if (fd < 0)
+			return nan;
+
+		std::uint64_t data[3];
+		if (::read(fd, data, sizeof data) != sizeof data)
+			return nan;
+		if (data[2] == 0)
+			return data[1] == 0 ? 0 : nan;
+		return double(data[0]) * data[1] / data[2];
+	}
+
+	std::array<int, nevents> fds_;
+	int error_ = 0;
+};
+
+} // namespace bench
+
+#endif // PHF_BENCH_PERF_H
@@ -0,0 +1,878 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <getopt.h>
+#include <sys/resource.h>
+
+#include "phf/builder.h"
+#include "phf/kperfect_map.h"
+#include "phf/paged.h"
+#include "phf/perfect_map.h"
+#include "phf/pthash.h"
+#include "phf/recsplit.h"
+
+#include "hash.h"
+#include "keys.h"
+#include "perf.h"
+#include "report.h"
+
+using namespace bench;
+
+using clock_type = std::chrono::steady_clock;
+
+//
+// Benchmark options.
+//
+struct options
+{
+	std::vector<std::string> keys = {"seq", "random", "url", "label", "prefix", "stride"};
+	std::vector<std::size_t> sizes = {1000, 10000, 100000, 1000000};
+	std::vector<std::string> engines = {"mph", "pthash", "recsplit", "pmap", "map"};
+	std::vector<double> gammas = {2};
+	std::vector<std::size_t> levels = {16};
+	std::vector<double> prefilters = {0};
+	std::size_t lookups = 1000000;
+	std::uint64_t seed = 1;
+	const char *csv_name = nullptr;
+	const char *json_name = nullptr;
+
+	// Hardware counters if enabled and available.
+	std::unique_ptr<perf_counters> counters;
+};
+
+//
+// All the configured reports.
+//
+struct reports
+{
+	std::unique_ptr<text_report> text;
+	std::unique_ptr<csv_report> csv;
+	std::unique_ptr<json_report> json;
+
+	void add(const result &r)
+	{
+		text->add(r);
+		if (csv)
+			csv->add(r);
+		if (json)
+			json->add(r);
+	}
+};
+
+static std::string
+format_double(double value)
+{
+	char buffer[32];
+	std::snprintf(buffer, sizeof buffer, "%g", value);
+	return buffer;
+}
+
+//
+// Engine adapters that provide a uniform interface to the hash function
+// objects and the baseline hash table.
+//
+
+template <std::size_t N, typename Key>
+class mph_engine
+{
+public:
+	using builder_type = phf::builder<N, Key, hash>;
+
+	mph_engine(double gamma, double prefilter, bool speculative)
+		: gamma_(gamma), prefilter_(prefilter), speculative_(speculative)
+	{
+	}
+
+	std::string name() const
+	{
+		return speculative_ ? "mph-spec" : "mph";
+	}
+
+	std::string params() const
+	{
+		std::string params = "gamma=" + format_double(gamma_) + " N=" + std::to_string(N);
+		if (prefilter_ != 0)
+			params += " pf=" + format_double(prefilter_);
+		return params;
+	}
+
+	void build(const std::vector<Key> &keys, std::uint64_t seed)
+	{
+		builder_type builder(gamma_, seed);
+		builder.set_prefilter(prefilter_);
+		for (const auto &key : keys)
+			builder.insert(key);
+		mph_ = builder.build();
+	}
+
+	// The membership lookup that uses the prefilter if any or the lookup
+	// that probes the first two levels at once.
+	std::size_t operator()(const Key &key) const
+	{
+		return speculative_ ? mph_->speculative_lookup(key) : mph_->find(key);
+	}
+
+	std::size_t memory_size() const
+	{
+		return mph_->memory_size();
+	}
+
+private:
+	double gamma_;
+	double prefilter_;
+	bool speculative_;
+	std::unique_ptr<typename builder_type::mph_type> mph_;
+};
+
+//
+// The mph that goes through a number of updates after the build. Each
+// update removes a slice of the keys of varying size and adds back the
+// slice removed by the previous one, so the final key set is the full
+// one. Both the shrinking and the growing updates happen and the remap
+// table gets long enough for some updates to build the function anew.
+// The build time includes the updates and the key order bookkeeping for
+// them. The ranks are verified by the update-check program instead.
+//
+template <typename Key>
+class mph_update_engine
+{
+public:
+	using builder_type = phf::builder<16, Key, hash>;
+	using mph_type = typename builder_type::mph_type;
+
+	explicit mph_update_engine(double gamma) : gamma_(gamma)
+	{
+	}
+
+	std::string name() const
+	{
+		return "mph-update";
+	}
+
+	std::string params() const
+	{
+		return "gamma=" + format_double(gamma_)
+		       + " N=16 upd=" + std::to_string(nupdates);
+	}
+
+	void build(const std::vector<Key> &keys, std::uint64_t seed)
+	{
+		builder_type builder(gamma_, seed);
+		for (const auto &key : keys)
+			builder.insert(key);
+		mph_ = builder.build();
+
+		std::vector<Key> keys_by_rank(keys.size());
+		for (const auto &key : keys)
+			keys_by_rank[(*mph_)[key]] = key;
+
+		std::size_t slice = keys.size() / 1000 + 1;
+		std::size_t next = 0;
+		std::vector<Key> added, removed;
+		for (unsigned i = 0; i <= nupdates; i++) {
+			added.swap(removed);
+			removed.clear();
+			std::size_t n = i < nupdates ? slice * (1 + i % 3) : 0;
+			for (; n != 0 && next < keys.size(); n--)
+				removed.push_back(keys[next++]);
+			update(builder, keys_by_rank, added, removed);
+		}
+	}
+
+	std::size_t operator()(const Key &key) const
+	{
+		return mph_->find(key);
+	}
+
+	std::size_t memory_size() const
+	{
+		return mph_->memory_size();
+	}
+
+private:
+	static constexpr unsigned nupdates = 10;
+
+	void update(builder_type &builder, std::vector<Key> &keys_by_rank,
+		    const std::vector<Key> &added, const std::vector<Key> &removed)
+	{
+		std::vector<std::pair<std::size_t, std::size_t>> moved;
+		auto result = builder.update(*mph_, keys_by_rank, added, removed, &moved);
+
+		// The remaining keys keep their ranks unless they are moved and
+		// the added keys are looked up.
+		std::vector<Key> next_keys_by_rank(result->size());
+		std::vector<bool> gone(keys_by_rank.size());
+		for (const auto &key : removed)
+			gone[(*mph_)[key]] = true;
+		for (const auto &move : moved) {
+			next_keys_by_rank[move.second] = keys_by_rank[move.first];
+			gone[move.first] = true;
+		}
+		for (std::size_t rank = 0; rank < keys_by_rank.size(); rank++) {
+			if (!gone[rank])
+				next_keys_by_rank[rank] = keys_by_rank[rank];
+		}
+		for (const auto &key : added)
+			next_keys_by_rank[(*result)[key]] = key;
+
+		mph_ = std::move(result);
+		keys_by_rank.swap(next_keys_by_rank);
+	}
+
+	double gamma_;
+	std::unique_ptr<mph_type> mph_;
+};
+
+template <typename Key>
+class paged_engine
+{
+public:
+	using builder_type = phf::paged_builder<8, Key, hash>;
+
+	explicit paged_engine(double gamma) : gamma_(gamma)
+	{
+	}
+
+	std::string name() const
+	{
+		return "paged";
+	}
+
+	std::string params() const
+	{
+		return "gamma=" + format_double(gamma_) + " N=8";
+	}
+
+	void build(const std::vector<Key> &keys, std::uint64_t seed)
+	{
+		builder_type builder(gamma_, seed);
+		for (const auto &key : keys)
+			builder.insert(key);
+		mph_ = builder.build();
+	}
+
+	std::size_t operator()(const Key &key) const
+	{
+		return (*mph_)[key];
+	}
+
+	std::size_t memory_size() const
+	{
+		return mph_->memory_size();
+	}
+
+private:
+	double gamma_;
+	std::unique_ptr<typename builder_type::mph_type> mph_;
+};
+
+template <typename Key>
+class pthash_engine
+{
+public:
+	using builder_type = phf::pthash_builder<Key, hash>;
+
+	std::string name() const
+	{
+		return "pthash";
+	}
+
+	std::string params() const
+	{
+		return "c=6 alpha=0.98";
+	}
+
+	void build(const std::vector<Key> &keys, std::uint64_t seed)
+	{
+		builder_type builder(6, seed, 0.98);
+		for (const auto &key : keys)
+			builder.insert(key);
+		mph_ = builder.build();
+	}
+
+	std::size_t operator()(const Key &key) const
+	{
+		return (*mph_)[key];
+	}
+
+	std::size_t memory_size() const
+	{
+		return mph_->memory_size();
+	}
+
+private:
+	std::unique_ptr<typename builder_type::mph_type> mph_;
+};
+
+template <typename Key>
+class recsplit_engine
+{
+public:
+	using builder_type = phf::recsplit_builder<Key, hash>;
+
+	std::string name() const
+	{
+		return "recsplit";
+	}
+
+	std::string params() const
+	{
+		return "leaf=8 bucket=100";
+	}
+
+	void build(const std::vector<Key> &keys, std::uint64_t seed)
+	{
+		builder_type builder(8, 100, seed);
+		for (const auto &key : keys)
+			builder.insert(key);
+		mph_ = builder.build();
+	}
+
+	std::size_t operator()(const Key &key) const
+	{
+		return (*mph_)[key];
+	}
+
+	std::size_t memory_size() const
+	{
+		return mph_->memory_size();
+	}
+
+private:
+	std::unique_ptr<typename builder_type::mph_type> mph_;
+};
+
+template <typename Key>
+class perfect_map_engine
+{
+public:
+	using builder_type = phf::perfect_map_builder<Key, std::size_t, hash>;
+
+	explicit perfect_map_engine(double gamma) : gamma_(gamma)
+	{
+	}
+
+	std::string name() const
+	{
+		return "pmap";
+	}
+
+	std::string params() const
+	{
+		return "gamma=" + format_double(gamma_);
+	}
+
+	void build(const std::vector<Key> &keys, std::uint64_t seed)
+	{
+		builder_type builder(gamma_, seed);
+		for (std::size_t i = 0; i < keys.size(); i++)
+			builder.insert(keys[i], i);
+		map_ = builder.build();
+	}
+
+	std::size_t operator()(const Key &key) const
+	{
+		auto value = map_->find(key);
+		return value ? *value : phf::not_found;
+	}
+
+	// The heap memory of long string keys is not counted.
+	std::size_t memory_size() const
+	{
+		return map_->memory_size();
+	}
+
+private:
+	double gamma_;
+	std::unique_ptr<typename builder_type::map_type> map_;
+};
+
+template <typename Key>
+class kperfect_map_engine
+{
+public:
+	using builder_type = phf::kperfect_map_builder<Key, std::size_t, hash>;
+
+	std::string name() const
+	{
+		return "kmap";
+	}
+
+	std::string params() const
+	{
+		return "load=0.85 k=" + std::to_string(builder_type::nslots);
+	}
+
+	void build(const std::vector<Key> &keys, std::uint64_t seed)
+	{
+		builder_type builder(0.85, seed);
+		for (std::size_t i = 0; i < keys.size(); i++)
+			builder.insert(keys[i], i);
+		map_ = builder.build();
+	}
+
+	std::size_t operator()(const Key &key) const
+	{
+		auto value = map_->find(key);
+		return value ? *value : phf::not_found;
+	}
+
+	std::size_t memory_size() const
+	{
+		return map_->memory_size();
+	}
+
+private:
+	std::unique_ptr<typename builder_type::map_type> map_;
+};
+
+template <typename Key>
+class map_engine
+{
+public:
+	std::string name() const
+	{
+		return "map";
+	}
+
+	std::string params() const
+	{
+		return "std::unordered_map";
+	}
+
+	void build(const std::vector<Key> &keys, std::uint64_t)
+	{
+		map_.reserve(keys.size());
+		for (std::size_t i = 0; i < keys.size(); i++)
+			map_.emplace(keys[i], i);
+	}
+
+	std::size_t operator()(const Key &key) const
+	{
+		auto it = map_.find(key);
+		return it == map_.end() ? phf::not_found : it->second;
+	}
+
+	// An estimate for the usual node based implementation. The heap
+	// memory of long string keys is not counted.
+	std::size_t memory_size() const
+	{
+		std::size_t node_size = sizeof(void *) + sizeof(std::size_t)
+					+ sizeof(typename map_type::value_type);
+		return map_.bucket_count() * sizeof(void *) + map_.size() * node_size;
+	}
+
+private:
+	using map_type = std::unordered_map<Key, std::size_t>;
+	map_type map_;
+};
+
+//
+// Memory usage measurement. The peak RSS value is reset before a build
+// if the kernel supports it. Otherwise the process-wide peak value is
+// used and the result might be overstated.
+//
+class memory_probe
+{
+public:
+	void start()
+	{
+		reset_ = reset_peak();
+		base_kb_ = read_status("VmRSS:");
+	}
+
+	double peak_mb() const
+	{
+		long peak_kb = reset_ ? read_status("VmHWM:") : -1;
+		if (peak_kb < 0) {
+			struct rusage usage;
+			getrusage(RUSAGE_SELF, &usage);
+			peak_kb = usage.ru_maxrss;
+		}
+		return peak_kb > base_kb_ ? (peak_kb - base_kb_) / 1024.0 : 0;
+	}
+
+private:
+	static bool reset_peak()
+	{
+		std::FILE *file = std::fopen("/proc/self/clear_refs", "w");
+		if (!file)
+			return false;
+		bool ok = std::fputs("5", file) >= 0;
+		return std::fclose(file) == 0 && ok;
+	}
+
+	static long read_status(const char *field)
+	{
+		std::FILE *file = std::fopen("/proc/self/status", "r");
+		if (!file)
+			return -1;
+
+		long value = -1;
+		char line[256];
+		std::size_t length = std::strlen(field);
+		while (std::fgets(line, sizeof line, file)) {
+			if (std::strncmp(line, field, length) == 0) {
+				value = std::strtol(line + length, nullptr, 10);
+				break;
+			}
+		}
+		std::fclose(file);
+		return value;
+	}
+
+	bool reset_ = false;
+	long base_kb_ = 0;
+};
+
+// A zero value unknown to the compiler. It is used to make a chain of
+// dependent lookups.
+static volatile std::size_t volatile_zero = 0;
+
+// A sink for lookup results.
+static volatile std::size_t volatile_sink;
+
+static void
+start_counters(const options &opts)
+{
+	if (opts.counters)
+		opts.counters->start();
+}
+
+static void
+stop_counters(const options &opts, double nops, std::vector<double> &values)
+{
+	if (opts.counters) {
+		opts.counters->stop();
+		auto counters = opts.counters->values(nops);
+		values.assign(counters.begin(), counters.end());
+	}
+}
+
+template <typename Engine, typename Key>
+void
+measure_lookups(const Engine &engine, const std::vector<Key> &keys, const options &opts,
+		double &latency_ns, double &mops, std::vector<double> &counters)
+{
+	std::size_t n = keys.size();
+	std::size_t nlookups = opts.lookups;
+	if (n == 0 || nlookups == 0)
+		return;
+
+	// Independent lookups. The hardware counters are captured for
+	// this loop.
+	std::size_t sum = 0;
+	start_counters(opts);
+	auto start = clock_type::now();
+	for (std::size_t i = 0, j = 0; i < nlookups; i++) {
+		sum += engine(keys[j]);
+		if (++j == n)
+			j = 0;
+	}
+	auto stop = clock_type::now();
+	stop_counters(opts, nlookups, counters);
+	std::chrono::duration<double> seconds = stop - start;
+	mops = nlookups / seconds.count() / 1e6;
+
+	// Dependent lookups, the next key is not known until the previous
+	// lookup completes.
+	std::size_t zero = volatile_zero;
+	start = clock_type::now();
+	for (std::size_t i = 0, j = 0; i < nlookups; i++) {
+		auto rank = engine(keys[j]);
+		sum += rank;
+		j += 1 + (rank & zero);
+		if (j >= n)
+			j = 0;
+	}
+	stop = clock_type::now();
+	seconds = stop - start;
+	latency_ns = seconds.count() * 1e9 / nlookups;
+
+	volatile_sink = sum;
+}
+
+template <typename Engine, typename Key>
+void
+run_engine(Engine &&engine, const std::string &kind, const key_set<Key> &keys,
+	   const options &opts, reports &out)
+{
+	result r;
+	r.keys = kind;
+	r.size = keys.positive.size();
+	r.engine = engine.name();
+	r.params = engine.params();
+
+	memory_probe probe;
+	probe.start();
+	start_counters(opts);
+	auto start = clock_type::now();
+	engine.build(keys.positive, opts.seed);
+	auto stop = clock_type::now();
+	stop_counters(opts, std::max(r.size, std::size_t{1}), r.build_counters);
+	r.build_seconds = std::chrono::duration<double>(stop - start).count();
+	r.build_peak_mb = probe.peak_mb();
+	r.bits_per_key = 8.0 * engine.memory_size() / std::max(r.size, std::size_t{1});
+
+	measure_lookups(engine, keys.positive, opts, r.positive_latency_ns, r.positive_mops,
+			r.positive_counters);
+	measure_lookups(engine, keys.negative, opts, r.negative_latency_ns, r.negative_mops,
+			r.negative_counters);
+
+	out.add(r);
+}
+
+template <typename Key>
+void
+run_mph(std::size_t levels, double gamma, double prefilter, bool speculative,
+	const std::string &kind, const key_set<Key> &keys, const options &opts, reports &out)
+{
+	switch (levels) {
+	case 4:
+		run_engine(mph_engine<4, Key>(gamma, prefilter, speculative), kind, keys, opts,
+			   out);
+		break;
+	case 8:
+		run_engine(mph_engine<8, Key>(gamma, prefilter, speculative), kind, keys, opts,
+			   out);
+		break;
+	case 16:
+		run_engine(mph_engine<16, Key>(gamma, prefilter, speculative), kind, keys, opts,
+			   out);
+		break;
+	case 32:
+		run_engine(mph_engine<32, Key>(gamma, prefilter, speculative), kind, keys, opts,
+			   out);
+		break;
+	default:
+		throw std::invalid_argument("unsupported level count: " + std::to_string(levels));
+	}
+}
+
+template <typename Key>
+void
+run_keys(const std::string &kind, const options &opts, reports &out)
+{
+	for (auto size : opts.sizes) {
+		rng::rng128 rng(opts.seed);
+		key_set<Key> keys;
+		generate(keys, kind, size, rng);
+
+		for (const auto &engine : opts.engines) {
+			if (engine == "mph" || engine == "mph-spec") {
+				bool speculative = engine == "mph-spec";
+				for (auto levels : opts.levels) {
+					for (auto gamma : opts.gammas) {
+						for (auto prefilter : opts.prefilters)
+							run_mph(levels, gamma, prefilter,
+								speculative, kind, keys, opts,
+								out);
+					}
+				}
+			} else if (engine == "mph-update") {
+				for (auto gamma : opts.gammas)
+					run_engine(mph_update_engine<Key>(gamma), kind, keys,
+						   opts, out);
+			} else if (engine == "paged") {
+				for (auto gamma : opts.gammas)
+					run_engine(paged_engine<Key>(gamma), kind, keys, opts, out);
+			} else if (engine == "pthash") {
+				run_engine(pthash_engine<Key>(), kind, keys, opts, out);
+			} else if (engine == "recsplit") {
+				run_engine(recsplit_engine<Key>(), kind, keys, opts, out);
+			} else if (engine == "pmap") {
+				for (auto gamma : opts.gammas)
+					run_engine(perfect_map_engine<Key>(gamma), kind, keys, opts,
+						   out);
+			} else if (engine == "kmap") {
+				run_engine(kperfect_map_engine<Key>(), kind, keys, opts, out);
+			} else if (engine == "map") {
+				run_engine(map_engine<Key>(), kind, keys, opts, out);
+			} else {
+				throw std::invalid_argument("unknown engine: " + engine);
+			}
+		}
+	}
+}
+
+static std::vector<std::string>
+split_list(const char *arg)
+{
+	std::vector<std::string> list;
+	std::string s(arg);
+	std::size_t start = 0;
+	while (start <= s.size()) {
+		auto end = s.find(',', start);
+		if (end == std::string::npos)
+			end = s.size();
+		if (end > start)
+			list.push_back(s.substr(start, end - start));
+		start = end + 1;
+	}
+	return list;
+}
+
+static double
+parse_number(const std::string &s)
+{
+	char *end;
+	double value = std::strtod(s.c_str(), &end);
+	if (end == s.c_str() || *end != 0 || value < 0)
+		throw std::invalid_argument("invalid number: " + s);
+	return value;
+}
+
+option long_options[] = {{"keys", required_argument, nullptr, 'k'},
+			 {"sizes", required_argument, nullptr, 'n'},
+			 {"engines", required_argument, nullptr, 'e'},
+			 {"gamma", required_argument, nullptr, 'g'},
+			 {"levels", required_argument, nullptr, 'l'},
+			 {"prefilter", required_argument, nullptr, 'f'},
+			 {"lookups", required_argument, nullptr, 'q'},
+			 {"seed", required_argument, nullptr, 's'},
+			 {"csv", required_argument, nullptr, 'c'},
+			 {"json", required_argument, nullptr, 'j'},
+			 {"perf", no_argument, nullptr, 'p'},
+			 {"help", no_argument, nullptr, 'h'},
+			 {nullptr, 0, nullptr, 0}};
+
+const char *prog_name = nullptr;
+
+[[noreturn]] void
+usage(int status)
+{
+	std::fprintf(stderr,
+		     "Usage: %s [options]\n"
+		     "  -k, --keys=LIST     key sets: seq,random,stride,url,label,prefix\n"
+		     "  -n, --sizes=LIST    key set sizes, e.g. 1e3,1e6,1e9\n"
+		     "  -e, --engines=LIST  engines: mph,mph-spec,mph-update,paged,pthash,recsplit,\n"
+		     "                      pmap,kmap,map\n"
+		     "  -g, --gamma=LIST    gamma values for mph, paged and pmap\n"
+		     "  -l, --levels=LIST   level counts (N) for mph: 4,8,16,32\n"
+		     "  -f, --prefilter=LIST\n"
+		     "                      prefilter false positive rates for mph, 0 for none\n"
+		     "  -q, --lookups=NUM   number of lookups per measurement\n"
+		     "  -s, --seed=NUM      random seed\n"
+		     "  -c, --csv=FILE      write results in the CSV format\n"
+		     "  -j, --json=FILE     write results in the JSON format\n"
+		     "  -p, --perf          capture hardware performance counters\n",
+		     prog_name);
+	std::exit(status);
+}
+
+static std::FILE *
+open_output(const char *name)
+{
+	std::FILE *file = std::fopen(name, "w");
+	if (!file)
+		throw std::runtime_error(std::string("failed to open file: ") + name);
+	return file;
+}
+
+int
+main(int ac, char *av[]) try {
+	options opts;
+
+	int c;
+	prog_name = av[0];
+	while ((c = getopt_long(ac, av, "k:n:e:g:l:f:q:s:c:j:ph", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'k':
+			opts.keys = split_list(optarg);
+			break;
+		case 'n':
+			opts.sizes.clear();
+			for (const auto &s : split_list(optarg))
+				opts.sizes.push_back(parse_number(s));
+			break;
+		case 'e':
+			opts.engines = split_list(optarg);
+			break;
+		case 'g':
+			opts.gammas.clear();
+			for (const auto &s : split_list(optarg))
+				opts.gammas.push_back(parse_number(s));
+			break;
+		case 'l':
+			opts.levels.clear();
+			for (const auto &s : split_list(optarg))
+				opts.levels.push_back(parse_number(s));
+			break;
+		case 'f':
+			opts.prefilters.clear();
+			for (const auto &s : split_list(optarg))
+				opts.prefilters.push_back(parse_number(s));
+			break;
+		case 'q':
+			opts.lookups = parse_number(optarg);
+			break;
+		case 's':
+			opts.seed = parse_number(optarg);
+			break;
+		case 'c':
+			opts.csv_name = optarg;
+			break;
+		case 'j':
+			opts.json_name = optarg;
+			break;
+		case 'p':
+			opts.counters = std::make_unique<perf_counters>();
+			break;
+		case 'h':
+			usage(EXIT_SUCCESS);
+		default:
+			usage(EXIT_FAILURE);
+		}
+	}
+	if (optind != ac)
+		usage(EXIT_FAILURE);
+	if (opts.counters && !opts.counters->available()) {
+		std::fprintf(stderr, "Hardware performance counters are not available: %s\n",
+			     std::strerror(opts.counters->error()));
+		opts.counters.reset();
+	}
+	bool with_counters = opts.counters != nullptr;
+
+	std::FILE *csv_file = nullptr;
+	std::FILE *json_file = nullptr;
+
+	reports out;
+	out.text = std::make_unique<text_report>(stdout);
+	out.text->header();
+	if (opts.csv_name) {
+		csv_file = open_output(opts.csv_name);
+		out.csv = std::make_unique<csv_report>(csv_file, with_counters);
+	}
+	if (opts.json_name) {
+		json_file = open_output(opts.json_name);
+		out.json = std::make_unique<json_report>(json_file, with_counters);
+	}
+
+	for (const auto &kind : opts.keys) {
+		if (is_integer_kind(kind))
+			run_keys<std::uint64_t>(kind, opts, out);
+		else if (is_string_kind(kind))
+			run_keys<std::string>(kind, opts, out);
+		else
+			throw std::invalid_argument("unknown key set: " + kind);
+	}
+
+	out.csv.reset();
+	out.json.reset();
+	if (csv_file)
+		std::fclose(csv_file);
+	if (json_file)
+		std::fclose(json_file);
+
+	return EXIT_SUCCESS;
+} catch (std::exception &e) {
+	std::cerr << "Exception occurred: " << e.what() << '\n';
+	return EXIT_FAILURE;
+}
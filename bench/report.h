@@ -0,0 +1,250 @@
+#ifndef PHF_BENCH_REPORT_H
+#define PHF_BENCH_REPORT_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "perf.h"
+
+namespace bench {
+
+//
+// A single benchmark result.
+//
+struct result
+{
+	std::string keys;
+	std::size_t size = 0;
+	std::string engine;
+	std::string params;
+
+	double build_seconds = 0;
+	double build_peak_mb = 0;
+	double bits_per_key = 0;
+
+	// Lookup latency is measured with a chain of dependent lookups,
+	// throughput is measured with independent lookups.
+	double positive_latency_ns = 0;
+	double positive_mops = 0;
+	double negative_latency_ns = 0;
+	double negative_mops = 0;
+
+	// Hardware counter values per build key and per lookup. These are
+	// empty if the counters are not enabled.
+	std::vector<double> build_counters;
+	std::vector<double> positive_counters;
+	std::vector<double> negative_counters;
+};
+
+// The phases with hardware counter values.
+static const char *const counter_phases[] = {"build", "positive", "negative"};
+
+//
+// The columns of the report.
+//
+struct column
+{
+	const char *name;
+	const char *format;
+};
+
+static inline std::string
+format_value(const char *fmt, double value)
+{
+	char buffer[64];
+	std::snprintf(buffer, sizeof buffer, fmt, value);
+	return buffer;
+}
+
+static inline std::vector<std::string>
+counter_fields(const result &r)
+{
+	std::vector<std::string> fields;
+	for (const auto *counters : {&r.build_counters, &r.positive_counters,
+				     &r.negative_counters}) {
+		for (auto value : *counters)
+			fields.push_back(format_value("%.3f", value));
+	}
+	return fields;
+}
+
+static inline std::vector<std::string>
+result_fields(const result &r)
+{
+	std::vector<std::string> fields = {
+		r.keys,
+		std::to_string(r.size),
+		r.engine,
+		r.params,
+		format_value("%.4f", r.build_seconds),
+		format_value("%.2f", r.build_peak_mb),
+		format_value("%.3f", r.bits_per_key),
+		format_value("%.1f", r.positive_latency_ns),
+		format_value("%.2f", r.positive_mops),
+		format_value("%.1f", r.negative_latency_ns),
+		format_value("%.2f", r.negative_mops),
+	};
+	for (auto &field : counter_fields(r))
+		fields.push_back(std::move(field));
+	return fields;
+}
+
+static const std::vector<column> result_columns = {
+	{"keys", "%-8s"},
+	{"size", "%12s"},
+	{"engine", "%-10s"},
+	{"params", "%-18s"},
+	{"build_s", "%10s"},
+	{"build_mb", "%10s"},
+	{"bits/key", "%9s"},
+	{"pos_lat_ns", "%11s"},
+	{"pos_mops", "%9s"},
+	{"neg_lat_ns", "%11s"},
+	{"neg_mops", "%9s"},
+};
+
+static const std::vector<std::string> base_names = {
+	"keys",
+	"size",
+	"engine",
+	"params",
+	"build_seconds",
+	"build_peak_mb",
+	"bits_per_key",
+	"positive_latency_ns",
+	"positive_mops",
+	"negative_latency_ns",
+	"negative_mops",
+};
+
+static inline std::vector<std::string>
+result_names(bool counters)
+{
+	auto names = base_names;
+	if (counters) {
+		for (auto phase : counter_phases) {
+			for (std::size_t i = 0; i < perf_counters::nevents; i++)
+				names.push_back(std::string(phase) + "_" + perf_counters::name(i));
+		}
+	}
+	return names;
+}
+
+//
+// Human readable output.
+//
+class text_report
+{
+public:
+	explicit text_report(std::FILE *file) : file_(file)
+	{
+	}
+
+	void header()
+	{
+		for (const auto &c : result_columns) {
+			std::fprintf(file_, c.format, c.name);
+			std::fputc(' ', file_);
+		}
+		std::fputc('\n', file_);
+	}
+
+	void add(const result &r)
+	{
+		auto fields = result_fields(r);
+		for (std::size_t i = 0; i < result_columns.size(); i++) {
+			std::fprintf(file_, result_columns[i].format, fields[i].c_str());
+			std::fputc(' ', file_);
+		}
+		std::fputc('\n', file_);
+
+		// Print the counters on separate lines, one line per phase.
+		auto counters = counter_fields(r);
+		std::size_t nphases = counters.size() / perf_counters::nevents;
+		for (std::size_t p = 0; p < nphases; p++) {
+			std::fprintf(file_, "    %-8s", counter_phases[p]);
+			for (std::size_t i = 0; i < perf_counters::nevents; i++) {
+				std::fprintf(file_, " %s=%s", perf_counters::name(i),
+					     counters[p * perf_counters::nevents + i].c_str());
+			}
+			std::fputc('\n', file_);
+		}
+		std::fflush(file_);
+	}
+
+private:
+	std::FILE *file_;
+};
+
+//
+// Machine readable output in the CSV format.
+//
+class csv_report
+{
+public:
+	csv_report(std::FILE *file, bool counters) : file_(file)
+	{
+		auto names = result_names(counters);
+		for (std::size_t i = 0; i < names.size(); i++)
+			std::fprintf(file_, i ? ",%s" : "%s", names[i].c_str());
+		std::fputc('\n', file_);
+	}
+
+	void add(const result &r)
+	{
+		auto fields = result_fields(r);
+		for (std::size_t i = 0; i < fields.size(); i++)
+			std::fprintf(file_, i ? ",\"%s\"" : "\"%s\"", fields[i].c_str());
+		std::fputc('\n', file_);
+		std::fflush(file_);
+	}
+
+private:
+	std::FILE *file_;
+};
+
+//
+// Machine readable output in the JSON format. The results are written
+// as an array of objects.
+//
+class json_report
+{
+public:
+	json_report(std::FILE *file, bool counters) : file_(file), names_(result_names(counters))
+	{
+		std::fputs("[\n", file_);
+	}
+
+	~json_report()
+	{
+		std::fputs("\n]\n", file_);
+	}
+
+	void add(const result &r)
+	{
+		auto fields = result_fields(r);
+		std::fputs(count_++ ? ",\n  {" : "  {", file_);
+		for (std::size_t i = 0; i < fields.size(); i++) {
+			// Only the key kind, engine and params are strings.
+			// Missing counter values are written as nulls.
+			bool quoted = i == 0 || i == 2 || i == 3;
+			const char *format = quoted ? "\"%s\": \"%s\"" : "\"%s\": %s";
+			const char *value = fields[i] == "nan" ? "null" : fields[i].c_str();
+			if (i)
+				std::fputs(", ", file_);
+			std::fprintf(file_, format, names_[i].c_str(), value);
+		}
+		std::fputc('}', file_);
+		std::fflush(file_);
+	}
+
+private:
+	std::FILE *file_;
+	std::vector<std::string> names_;
+	std::size_t count_ = 0;
+};
+
+} // namespace bench
+
+#endif // PHF_BENCH_REPORT_H
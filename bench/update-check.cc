@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "phf/builder.h"
+
+#include "hash.h"
+#include "keys.h"
+
+using namespace bench;
+
+//
+// Check the ranks of the mph through a number of updates. Each update
+// removes a slice of the keys of varying size and adds back the slice
+// removed by the previous one as the mph-update benchmark engine does.
+// The function must keep the ranks of the remaining keys except for the
+// reported moves and the ranks of all the keys must form a range. The
+// remap limits include zero that builds the function anew on each
+// update and a tiny one that leaves the floor of the table size.
+//
+template <typename Key>
+class update_check
+{
+public:
+	using builder_type = phf::builder<16, Key, hash>;
+	using mph_type = typename builder_type::mph_type;
+
+	update_check(double remap_limit, unsigned fingerprint_bits)
+		: remap_limit_(remap_limit), fingerprint_bits_(fingerprint_bits)
+	{
+	}
+
+	void run(const std::vector<Key> &keys, std::uint64_t seed)
+	{
+		builder_type builder(2, seed, fingerprint_bits_);
+		builder.set_remap_limit(remap_limit_);
+		for (const auto &key : keys)
+			builder.insert(key);
+		mph_ = builder.build();
+
+		keys_by_rank_.assign(keys.size(), Key());
+		for (const auto &key : keys)
+			keys_by_rank_[(*mph_)[key]] = key;
+
+		std::size_t slice = keys.size() / 100 + 1;
+		std::size_t next = 0;
+		std::vector<Key> added, removed;
+		for (unsigned i = 0; i <= nupdates; i++) {
+			added.swap(removed);
+			removed.clear();
+			std::size_t n = i < nupdates ? slice * (1 + i % 3) : 0;
+			for (; n != 0 && next < keys.size(); n--)
+				removed.push_back(keys[next++]);
+			update(builder, added, removed);
+		}
+		if (mph_->size() != keys.size())
+			throw std::runtime_error("wrong key count after the last update");
+	}
+
+	std::size_t nmoved() const
+	{
+		return nmoved_;
+	}
+
+	std::size_t max_runs() const
+	{
+		return max_runs_;
+	}
+
+private:
+	static constexpr unsigned nupdates = 30;
+
+	void update(builder_type &builder, const std::vector<Key> &added,
+		    const std::vector<Key> &removed)
+	{
+		std::vector<std::pair<std::size_t, std::size_t>> moved;
+		auto result = builder.update(*mph_, keys_by_rank_, added, removed, &moved);
+
+		std::size_t size = keys_by_rank_.size() - removed.size() + added.size();
+		if (result->size() != size)
+			throw std::runtime_error("wrong key count after update");
+
+		std::vector<std::size_t> ranks(keys_by_rank_.size());
+		for (std::size_t rank = 0; rank < ranks.size(); rank++)
+			ranks[rank] = rank;
+		for (const auto &move : moved) {
+			if (move.first >= ranks.size() || ranks[move.first] != move.first)
+				throw std::runtime_error("invalid move after update");
+			ranks[move.first] = move.second;
+		}
+
+		std::vector<Key> next_keys_by_rank(size);
+		std::vector<bool> taken(size);
+		auto check = [&](const Key &key, std::size_t expected) {
+			auto rank = (*result)[key];
+			if (rank >= size || taken[rank])
+				throw std::runtime_error("duplicate rank after update");
+			if (expected != phf::not_found && rank != expected)
+				throw std::runtime_error("unreported rank change after update");
+			if (result->find(key) != rank)
+				throw std::runtime_error("find() disagrees with the rank");
+			taken[rank] = true;
+			next_keys_by_rank[rank] = key;
+		};
+		std::unordered_set<Key> removed_keys(removed.begin(), removed.end());
+		for (std::size_t rank = 0; rank < keys_by_rank_.size(); rank++) {
+			if (!removed_keys.count(keys_by_rank_[rank]))
+				check(keys_by_rank_[rank], ranks[rank]);
+		}
+		for (const auto &key : added)
+			check(key, phf::not_found);
+
+		nmoved_ += moved.size();
+		max_runs_ = std::max(max_runs_, result->remap().size());
+		mph_ = std::move(result);
+		keys_by_rank_.swap(next_keys_by_rank);
+	}
+
+	double remap_limit_;
+	unsigned fingerprint_bits_;
+	std::unique_ptr<mph_type> mph_;
+	std::vector<Key> keys_by_rank_;
+	std::size_t nmoved_ = 0;
+	std::size_t max_runs_ = 0;
+};
+
+template <typename Key>
+static void
+check_keys(const std::string &kind, std::size_t size)
+{
+	rng::rng128 rng(size);
+	key_set<Key> keys;
+	generate(keys, kind, size, rng);
+
+	const double default_limit = update_check<Key>::builder_type::default_remap_limit;
+	for (double limit : {default_limit, 0.0, 1e-6}) {
+		for (unsigned fingerprint_bits : {0u, 8u}) {
+			update_check<Key> check(limit, fingerprint_bits);
+			check.run(keys.positive, rng());
+			std::printf("%s n=%zu limit=%g fp=%u: %zu moved, %zu runs at most\n",
+				    kind.c_str(), size, limit, fingerprint_bits, check.nmoved(),
+				    check.max_runs());
+		}
+	}
+}
+
+int
+main() try {
+	for (std::size_t size : {1000, 20000}) {
+		check_keys<std::uint64_t>("random", size);
+		check_keys<std::string>("url", size);
+	}
+	return EXIT_SUCCESS;
+} catch (std::exception &e) {
+	std::cerr << "update-check: " << e.what() << '\n';
+	return EXIT_FAILURE;
+}
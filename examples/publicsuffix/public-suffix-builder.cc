@@ -265,20 +265,21 @@ public:
 	void BuildMPHF()
 	{
 		auto seed = rng::random_device_seed{}();
-		phf::builder<16, std::string, Hash> builder(3, seed);
+		// Most non-matching labels are rejected by 8-bit fingerprints
+		// before the full label comparison.
+		phf::builder<16, std::string, Hash> builder(3, seed, 8);
 		for (const auto &suffix : second_level_)
 			builder.insert(suffix.second.label_);
 
-		auto mph = builder.build();
-
+		// The builder reports the key ranks so the labels are not looked
+		// up once more.
 		std::vector<Suffix *> index(second_level_.size());
-		for (auto &suffix : second_level_) {
-			auto i = (*mph)[suffix.second.label_];
+		auto mph = builder.build([&](const std::string &label, std::size_t i) {
 			if (i >= index.size())
 				throw std::runtime_error("mph produced invalid index "
 							 + std::to_string(i));
-			index[i] = &suffix.second;
-		}
+			index[i] = &second_level_.at(label);
+		});
 
 		BuildContext ctx;
 		for (Suffix *s : index) {
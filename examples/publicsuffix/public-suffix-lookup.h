@@ -16,7 +16,7 @@ using namespace phf;
 static inline Node *
 lookup_second_level(string_view label)
 {
-	auto rank = second_level_index::instance[label];
+	auto rank = second_level_index::instance.find(label);
 	if (rank == phf::not_found)
 		return nullptr;
 
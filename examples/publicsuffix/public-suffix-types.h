@@ -17,6 +17,7 @@
 // clang-format on
 
 #include "SpookyV2.h"
+#include "phf/fragments.h"
 
 namespace public_suffix {
 
@@ -58,7 +59,7 @@ struct Fnv64
 	static constexpr std::uint64_t FNV1_64_INIT = UINT64_C(0xcbf29ce484222325);
 	static constexpr std::uint64_t FNV_64_PRIME = UINT64_C(0x100000001b3);
 
-	result_type operator()(string_view data, std::uint64_t hval)
+	result_type operator()(string_view data, std::uint64_t hval) const
 	{
 		auto *bp = reinterpret_cast<const unsigned char *>(data.data());
 		auto *ep = reinterpret_cast<const unsigned char *>(data.data()) + data.size();
@@ -69,7 +70,7 @@ struct Fnv64
 		return hval;
 	}
 
-	result_type operator()(string_view data)
+	result_type operator()(string_view data) const
 	{
 		return operator()(data, FNV1_64_INIT);
 	}
@@ -79,10 +80,22 @@ struct Spooky
 {
 	using result_type = std::uint64_t;
 
-	result_type operator()(string_view data, std::uint64_t seed)
+	result_type operator()(string_view data, std::uint64_t seed) const
 	{
 		return SpookyHash::Hash64(data.data(), data.size(), seed);
 	}
+
+	// A label split across several buffers. The incremental hash gives
+	// the same result as for the contiguous label.
+	result_type operator()(const phf::fragments &data, std::uint64_t seed) const
+	{
+		SpookyHash spooky;
+		spooky.Init(seed, seed);
+		data.for_each([&spooky](const char *p, std::size_t n) { spooky.Update(p, n); });
+		std::uint64_t hash1, hash2;
+		spooky.Final(&hash1, &hash2);
+		return hash1;
+	}
 };
 
 } // namespace public_suffix
@@ -0,0 +1,169 @@
+#ifndef PERFECT_HASH_BITS_H
+#define PERFECT_HASH_BITS_H
+
+#include <cstdint>
+#include <vector>
+
+namespace phf {
+namespace bits {
+
+//
+// Get the number of bits required to represent a given value.
+//
+static inline unsigned
+width(std::uint64_t value)
+{
+	return value ? 64 - __builtin_clzll(value) : 0;
+}
+
+//
+// Get a mask for the given number of low bits.
+//
+static inline std::uint64_t
+mask(unsigned nbits)
+{
+	return nbits < 64 ? (UINT64_C(1) << nbits) - 1 : ~UINT64_C(0);
+}
+
+//
+// Mix the bits of a value. This is the finalizer of the splitmix64
+// generator.
+//
+static constexpr std::uint64_t
+mix(std::uint64_t z)
+{
+	z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+	return z ^ (z >> 31);
+}
+
+//
+// Find the position of the set bit with the given index in a word.
+//
+static inline unsigned
+select(std::uint64_t word, unsigned index)
+{
+	for (; index; index--)
+		word &= word - 1;
+	return __builtin_ctzll(word);
+}
+
+//
+// Map a 32-bit hash value to the [0, n) range without division.
+//
+static constexpr std::uint64_t
+reduce32(std::uint32_t hash, std::uint32_t n)
+{
+	return (std::uint64_t{hash} * n) >> 32;
+}
+
+//
+// Map a 64-bit hash value to the [0, n) range without division.
+//
+static inline std::uint64_t
+reduce64(std::uint64_t hash, std::uint64_t n)
+{
+	return (static_cast<unsigned __int128>(hash) * n) >> 64;
+}
+
+//
+// Get a field of up to 64 bits from a packed array of 64-bit words.
+//
+template <typename Words>
+static inline std::uint64_t
+get(const Words &words, std::size_t offset, unsigned nbits)
+{
+	if (nbits == 0)
+		return 0;
+
+	auto index = offset / 64;
+	auto shift = offset % 64;
+	std::uint64_t value = words[index] >> shift;
+	if (shift + nbits > 64)
+		value |= words[index + 1] << (64 - shift);
+	return value & mask(nbits);
+}
+
+//
+// Store a field of up to 64 bits to a packed array of 64-bit words. The
+// target bits are expected to be clear.
+//
+template <typename Words>
+static inline void
+put(Words &words, std::size_t offset, unsigned nbits, std::uint64_t value)
+{
+	if (nbits == 0)
+		return;
+
+	value &= mask(nbits);
+	auto index = offset / 64;
+	auto shift = offset % 64;
+	words[index] |= value << shift;
+	if (shift + nbits > 64)
+		words[index + 1] |= value >> (64 - shift);
+}
+
+//
+// Get the number of 64-bit words required to store the given number
+// of bits.
+//
+static inline std::size_t
+nwords(std::size_t nbits)
+{
+	return (nbits + 63) / 64;
+}
+
+//
+// A growing bit array that is filled sequentially.
+//
+class writer
+{
+public:
+	void append(std::uint64_t value, unsigned nbits)
+	{
+		words_.resize(nwords(size_ + nbits));
+		put(words_, size_, nbits, value);
+		size_ += nbits;
+	}
+
+	// Append a value in the unary code: the given number of zeros
+	// followed by a single one.
+	void append_unary(std::uint64_t value)
+	{
+		size_ += value;
+		append(1, 1);
+	}
+
+	void append(const writer &other)
+	{
+		for (std::size_t i = 0; i < other.size_; i += 64) {
+			unsigned nbits = other.size_ - i < 64 ? other.size_ - i : 64;
+			append(other.words_[i / 64], nbits);
+		}
+	}
+
+	void clear()
+	{
+		words_.clear();
+		size_ = 0;
+	}
+
+	std::size_t size() const
+	{
+		return size_;
+	}
+
+	std::vector<std::uint64_t> &words()
+	{
+		return words_;
+	}
+
+private:
+	std::vector<std::uint64_t> words_;
+	std::size_t size_ = 0;
+};
+
+} // namespace bits
+} // namespace phf
+
+#endif // PERFECT_HASH_BITS_H
@@ -0,0 +1,135 @@
+#ifndef PERFECT_HASH_BLOOM_H
+#define PERFECT_HASH_BLOOM_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "bits.h"
+#include "serialize.h"
+
+namespace phf {
+
+//
+// A blocked Bloom filter keyed by a hash value. All the bits of a value
+// are set within a single 512-bit block so a lookup touches one cache
+// line. It is used to reject most non-member keys before the function
+// levels are probed.
+//
+// The hash value is mixed again so the filter might be keyed by a value
+// that is also used for other purposes, for instance the level 0 hash.
+//
+class blocked_bloom
+{
+public:
+	// The serialized object tag: "BLOCKBF1".
+	static constexpr std::uint64_t tag = UINT64_C(0x3146424b434f4c42);
+
+	static constexpr std::size_t block_nwords = 8;
+	static constexpr std::size_t block_nbits = block_nwords * 64;
+	static constexpr unsigned max_nhashes = 16;
+
+	blocked_bloom()
+	{
+	}
+
+	// Create an empty filter for the given number of values with about
+	// the given false positive rate.
+	blocked_bloom(std::size_t size, double false_positive_rate)
+	{
+		if (!(false_positive_rate > 0 && false_positive_rate < 1))
+			throw std::invalid_argument("invalid false positive rate");
+
+		// The blocked filter needs somewhat more bits than the standard
+		// one for the same rate.
+		double bits_per_value = 1.2 * std::log2(1 / false_positive_rate) / std::log(2);
+		long nhashes = std::lround(bits_per_value * std::log(2));
+		nhashes_ = nhashes < 1 ? 1 : nhashes > max_nhashes ? max_nhashes : nhashes;
+
+		std::size_t nblocks = std::ceil(size * bits_per_value / block_nbits);
+		words_.resize(std::max(nblocks, std::size_t{1}) * block_nwords);
+	}
+
+	blocked_bloom(unsigned nhashes, std::vector<std::uint64_t> &&words)
+		: nhashes_(nhashes), words_(std::move(words))
+	{
+		if (nhashes_ == 0 || nhashes_ > max_nhashes || words_.size() % block_nwords != 0)
+			throw std::invalid_argument("invalid Bloom filter");
+	}
+
+	bool empty() const
+	{
+		return words_.empty();
+	}
+
+	unsigned nhashes() const
+	{
+		return nhashes_;
+	}
+
+	const std::vector<std::uint64_t> &words() const
+	{
+		return words_;
+	}
+
+	std::size_t memory_size() const
+	{
+		return words_.size() * sizeof(std::uint64_t);
+	}
+
+	void insert(std::uint64_t hash)
+	{
+		std::uint64_t *block = &words_[block_index(hash)];
+		std::uint64_t x = bits::mix(hash);
+		std::uint32_t a = x, b = (x >> 32) | 1;
+		for (unsigned i = 0; i < nhashes_; i++, a += b)
+			block[(a % block_nbits) / 64] |= UINT64_C(1) << (a % 64);
+	}
+
+	bool contains(std::uint64_t hash) const
+	{
+		const std::uint64_t *block = &words_[block_index(hash)];
+		std::uint64_t x = bits::mix(hash);
+		std::uint32_t a = x, b = (x >> 32) | 1;
+		for (unsigned i = 0; i < nhashes_; i++, a += b) {
+			if ((block[(a % block_nbits) / 64] & (UINT64_C(1) << (a % 64))) == 0)
+				return false;
+		}
+		return true;
+	}
+
+	void write(std::ostream &os) const
+	{
+		io::write_tag(os, tag);
+		io::write(os, nhashes_);
+		io::write(os, words_);
+	}
+
+	void read(std::istream &is)
+	{
+		unsigned nhashes;
+		std::vector<std::uint64_t> words;
+		io::read_tag(is, tag);
+		io::read(is, nhashes);
+		io::read(is, words);
+		*this = words.empty() ? blocked_bloom() : blocked_bloom(nhashes, std::move(words));
+	}
+
+private:
+	std::size_t block_index(std::uint64_t hash) const
+	{
+		std::uint64_t x = bits::mix(hash ^ UINT64_C(0x9e3779b97f4a7c15));
+		return bits::reduce64(x, words_.size() / block_nwords) * block_nwords;
+	}
+
+	unsigned nhashes_ = 0;
+	std::vector<std::uint64_t> words_;
+};
+
+} // namespace phf
+
+#endif // PERFECT_HASH_BLOOM_H
@@ -4,16 +4,24 @@
 #include <algorithm>
 #include <array>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <type_traits>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "bits.h"
+#include "bloom.h"
 #include "hasher.h"
 #include "mph.h"
 
 namespace phf {
 
-template <std::size_t N, typename Key, typename Hash = std::hash<Key>>
+template <std::size_t N, typename Key, typename Hash = std::hash<Key>,
+	  typename Bitset = std::vector<std::uint64_t>, bool minimal = true>
 class builder
 {
 public:
@@ -23,10 +31,60 @@ public:
 
 	static constexpr std::size_t count = hasher_type::count;
 
-	using mph_type = minimal_perfect_hash<count, key_type, base_hasher_type>;
+	using mph_type = minimal_perfect_hash<count, key_type, base_hasher_type, std::size_t,
+					      Bitset, true, minimal>;
+	using bitset_type = typename mph_type::bitset_type;
 
-	builder(double gamma, std::uint64_t seed) : gamma_(gamma), seed_(seed), hasher_(seed)
+	// The default number of seeds tried for each level of a weighted
+	// key set.
+	static constexpr unsigned default_seed_trials = 16;
+
+	// The default limit of the rank remap table runs per key for the
+	// update. Each run takes 16 bytes so this is 2 bits per key.
+	static constexpr double default_remap_limit = 1.0 / 64;
+
+	// The number of remap table runs that any function might have under
+	// a nonzero limit. The table of 16KB stays in the cache so a small
+	// function is not built anew for each update.
+	static constexpr std::size_t min_remap_runs = 1024;
+
+	builder(double gamma, std::uint64_t seed, unsigned fingerprint_bits = 0,
+		unsigned seed_trials = default_seed_trials)
+		: gamma_(gamma), seed_(seed), fingerprint_bits_(fingerprint_bits),
+		  seed_trials_(std::max(seed_trials, 1u)), hasher_(seed)
+	{
+		if (fingerprint_bits != 0 && (fingerprint_bits < mph_type::min_fingerprint_bits
+					      || fingerprint_bits > mph_type::max_fingerprint_bits))
+			throw std::invalid_argument("invalid fingerprint size");
+		if (fingerprint_bits != 0 && !minimal)
+			throw std::invalid_argument("fingerprints need a minimal function");
+	}
+
+	//
+	// Add a Bloom filter prefilter with the given false positive rate to
+	// the functions that are built. It rejects most non-member keys with
+	// a single cache line access before the levels are probed. A zero
+	// rate disables it.
+	//
+	void set_prefilter(double false_positive_rate)
+	{
+		if (false_positive_rate != 0
+		    && !(false_positive_rate > 0 && false_positive_rate < 1))
+			throw std::invalid_argument("invalid false positive rate");
+		prefilter_rate_ = false_positive_rate;
+	}
+
+	//
+	// Set the largest number of rank remap table runs per key that the
+	// update might leave in the function but no less than min_remap_runs
+	// unless it is zero. If an update would exceed it then the function
+	// is built anew instead.
+	//
+	void set_remap_limit(double runs_per_key)
 	{
+		if (!(runs_per_key >= 0))
+			throw std::invalid_argument("invalid remap limit");
+		remap_limit_ = runs_per_key;
 	}
 
 	void insert(const key_type &key)
@@ -34,54 +92,106 @@ public:
 		keys_.insert(key);
 	}
 
+	//
+	// Insert a key with the given weight such as its access frequency.
+	// The keys without a weight have the weight of 1. If any weight is
+	// given then several seeds are tried for each level and the one that
+	// places the most weight there is chosen. So the frequently used keys
+	// tend to take the lower levels and need fewer probes. The weights of
+	// a repeated key are summed so an access sample might be inserted
+	// as is.
+	//
+	void insert(const key_type &key, double weight)
+	{
+		keys_.insert(key);
+		weights_[key] += weight;
+	}
+
 	std::unique_ptr<mph_type> build()
 	{
+		return build(no_ranks());
+	}
+
+	//
+	// Build the function and report the lookup result of each key to the
+	// given callback as on_rank(key, rank) so the caller might lay out
+	// its payload in the rank order without looking all the keys up once
+	// more. The rank of a placed key is known as soon as its level is
+	// filled because the lower levels are final by then. The callback is
+	// called in no particular order.
+	//
+	template <typename OnRank>
+	std::unique_ptr<mph_type> build(OnRank on_rank)
+	{
+		constexpr bool report = !std::is_same<OnRank, no_ranks>::value;
+
 		std::size_t nlevels = count;
 		std::vector<bool> level_bits[count];
 		std::vector<bool> filter;
 
+		// The bit positions and level 0 hash values of the placed keys
+		// to produce the key fingerprints.
+		std::vector<std::pair<std::size_t, std::uint64_t>> placed;
+		std::size_t level_base = 0;
+		// The number of keys placed on the lower levels.
+		std::size_t rank_base = 0;
+
+		// The prefilter gets the level 0 hash values of the placed keys.
+		// The extra keys are added to it later.
+		blocked_bloom prefilter;
+		if (prefilter_rate_ != 0)
+			prefilter = blocked_bloom(keys_.size(), prefilter_rate_);
+
 #if PHF_DEBUG > 0
 		std::array<std::size_t, count> level_ranks{{0}};
 		std::array<std::size_t, count> level_conflicts{{0}};
 #endif
 		for (std::size_t level = 0; level < count; level++) {
-			if (keys_.empty()) {
+			// Level 0 is always present even for an empty key set.
+			if (keys_.empty() && level > 0) {
 				nlevels = level;
 				break;
 			}
 
 			// Find a conflict-free key set.
-			fill_level(level, level_bits[level]);
+			if (weights_.empty())
+				fill_level(level, level_bits[level]);
+			else
+				fill_weighted_level(level, level_bits[level]);
 
 			// Set key filter size equal to the first level size.
 			if (level == 0)
 				filter.resize(level_bits[0].size());
 
-			auto it = keys_.begin();
 			auto size = level_bits[level].size();
-			while (it != keys_.end()) {
-				hasher_ = *it;
-				auto hash = hasher_[level];
-				std::size_t index = hash & (size - 1);
-
-				if (level_bits[level][index]) {
-					keys_.erase(it++);
+			rank_directory ranks;
+			if (report && minimal)
+				ranks = rank_directory(level_bits[level]);
+			place_level(
+				level, level_bits[level],
+				[&](std::size_t index, const key_type &key) {
+					if (report)
+						on_rank(key, minimal ? rank_base + ranks(index)
+								     : level_base + index);
+					if (fingerprint_bits_ != 0)
+						placed.emplace_back(level_base + index, hasher_[0]);
+					if (!prefilter.empty())
+						prefilter.insert(hasher_[0]);
 #if PHF_DEBUG > 0
 					level_ranks[level]++;
 #endif
-				} else {
-					++it;
-
+				},
+				[&](std::uint64_t hash) {
 					// Mark a conflicting key in the filter.
-					if (level < 2) {
-						index = hash & (filter.size() - 1);
-						filter[index] = true;
-					}
+					if (level < 2)
+						filter[hash & (filter.size() - 1)] = true;
 #if PHF_DEBUG > 0
 					level_conflicts[level]++;
 #endif
-				}
-			}
+				});
+			level_base += size;
+			// Each set bit holds one key.
+			rank_base += ranks.size();
 		}
 
 #if PHF_DEBUG > 0
@@ -99,11 +209,11 @@ public:
 			sizes[level] = level_bits[level].size();
 			total_size += sizes[level];
 		}
-		if (nlevels > 1)
-			total_size += filter.size();
+		total_size += filter.size();
+		total_size += placed.size() * fingerprint_bits_;
 
 		std::size_t bit_index = 0;
-		std::vector<std::uint64_t> bitset((total_size + 63) / 64);
+		bitset_type bitset((total_size + 63) / 64);
 		for (std::size_t level = 0; level < nlevels; level++) {
 			for (std::size_t index = 0; index < sizes[level]; index++) {
 				if (level_bits[level][index]) {
@@ -113,20 +223,373 @@ public:
 				bit_index++;
 			}
 		}
-		if (nlevels > 1) {
-			for (std::size_t index = 0; index < filter.size(); index++) {
-				if (filter[index]) {
-					auto mask = UINT64_C(1) << (bit_index % 64);
-					bitset[bit_index / 64] |= mask;
-				}
-				bit_index++;
+		for (std::size_t index = 0; index < filter.size(); index++) {
+			if (filter[index]) {
+				auto mask = UINT64_C(1) << (bit_index % 64);
+				bitset[bit_index / 64] |= mask;
+			}
+			bit_index++;
+		}
+
+		// The key ranks follow the order of their bit positions.
+		std::sort(placed.begin(), placed.end());
+		for (const auto &p : placed) {
+			auto value = mph_type::fingerprint(p.second, fingerprint_bits_);
+			bits::put(bitset, bit_index, fingerprint_bits_, value);
+			bit_index += fingerprint_bits_;
+		}
+
+		auto result = std::make_unique<mph_type>(hasher_, sizes, std::move(bitset),
+							 fingerprint_bits_);
+		result->set_prefilter(std::move(prefilter));
+		for (const auto &key : keys_) {
+			auto rank = result->insert(key);
+			if (report)
+				on_rank(key, rank);
+		}
+
+		return result;
+	}
+
+	//
+	// Update a function built before for a changed key set reusing as
+	// much of it as possible. The bits of the leading levels are kept
+	// except for those of the removed keys and of the keys that collide
+	// with the added keys there. The added keys, the evicted keys and the
+	// keys of the trailing levels that hold no more keys than the change
+	// itself are placed to the trailing levels anew. So the update costs
+	// are proportional to the change size rather than to the key set size
+	// and the number of levels stays about the same.
+	//
+	// The keys that stay in the set keep their ranks and the added keys
+	// take the ranks freed by the removed keys first. This is done with
+	// a compact table of rank runs in the resulting function. If the set
+	// shrinks then the keys with the ranks beyond the new set size are
+	// moved to the remaining free ranks so the function stays minimal.
+	// These moves are reported as (old rank, new rank) pairs.
+	//
+	// The remap table is searched on every lookup. The runs of each update
+	// are merged with those of the previous one, so the table has about
+	// two runs for each key that left its place in the bitset: one where
+	// it was and one where it is now. The evicted keys are displaced too,
+	// so a 1000 key update of 1M keys adds about 8K runs, that is a bit
+	// per key, and makes the lookups about 1.3 times slower. So if the
+	// table would get more runs than the remap limit allows then the
+	// function is built anew. The remaining keys keep their ranks in the
+	// longest runs that the new bitset order leaves, up to half the limit
+	// so that the next updates have room. The others are renumbered and
+	// reported as moves, less than half of the keys with the default
+	// limit. This takes about as long as a build of the new key set.
+	//
+	// To find the owners of the evicted bits the update needs the current
+	// keys in the rank order: keys_by_rank[rank] is the key with the given
+	// rank. The removed keys must be in the set, the added keys that are
+	// already there are ignored. The builder parameters other than the
+	// gamma value are taken from the previous function.
+	//
+	template <typename KeysByRank>
+	std::unique_ptr<mph_type>
+	update(const mph_type &prev, const KeysByRank &keys_by_rank,
+	       const std::vector<key_type> &added, const std::vector<key_type> &removed,
+	       std::vector<std::pair<std::size_t, std::size_t>> *moved = nullptr)
+	{
+		static_assert(minimal, "the update needs a minimal function");
+		using remap_entry = typename mph_type::remap_entry;
+		const std::size_t nmoved = moved ? moved->size() : 0;
+
+		// Use the builder state for the new levels.
+		hasher_type saved_hasher = hasher_;
+		std::unordered_set<key_type> saved_keys;
+		saved_keys.swap(keys_);
+		hasher_ = prev.key_hasher();
+
+		const auto &prev_levels = prev.levels();
+		const auto &prev_bitset = prev.bitset();
+		const unsigned fingerprint_bits = prev.fingerprint_bits();
+		const std::size_t old_size = prev.size();
+
+		std::size_t nlevels = 0;
+		std::size_t rank_space = 0;
+		std::array<std::size_t, count + 1> level_bases{{0}};
+		while (nlevels < count && prev_levels[nlevels] != 0) {
+			rank_space += prev_levels[nlevels++];
+			level_bases[nlevels] = rank_space;
+		}
+		const std::size_t filter_size = prev_levels[0];
+
+		// The old level bits with the bits of the removed and evicted
+		// keys cleared and the old filter.
+		std::vector<std::uint64_t> words(prev_bitset.begin(),
+						 prev_bitset.begin() + rank_space / 64);
+		std::vector<std::uint64_t> filter(
+			prev_bitset.begin() + rank_space / 64,
+			prev_bitset.begin() + (rank_space + filter_size) / 64);
+		std::size_t prev_internal = 0;
+		for (auto word : words)
+			prev_internal += __builtin_popcountll(word);
+
+		// The bitset ranks of the cleared bits.
+		std::vector<std::size_t> cleared;
+
+		// The keys to place anew with their ranks if they have any.
+		std::unordered_map<key_type, std::size_t> ranks(prev.extra_keys().begin(),
+								prev.extra_keys().end());
+
+		auto clear_bit = [&](std::size_t bit_index) {
+			words[bit_index / 64] &= ~(UINT64_C(1) << (bit_index % 64));
+			cleared.push_back(prev.bit_rank(bit_index));
+			auto rank = prev.external_rank(cleared.back());
+			ranks.emplace(keys_by_rank[rank], rank);
+			return keys_by_rank[rank];
+		};
+		auto mark_filter = [&](std::uint64_t hash) {
+			auto index = hash & (filter_size - 1);
+			filter[index / 64] |= UINT64_C(1) << (index % 64);
+		};
+		auto is_member = [&](const key_type &key, std::size_t &rank) {
+			rank = prev[key];
+			return rank < old_size && keys_by_rank[rank] == key;
+		};
+
+		std::vector<std::size_t> holes;
+		std::unordered_set<key_type> removed_keys;
+		for (const auto &key : removed) {
+			if (!removed_keys.insert(key).second)
+				continue;
+			std::size_t rank;
+			if (!is_member(key, rank))
+				throw std::invalid_argument("removed key is not in the set");
+			holes.push_back(rank);
+			if (!ranks.erase(key)) {
+				auto bit_index = prev.position(key);
+				words[bit_index / 64] &= ~(UINT64_C(1) << (bit_index % 64));
+				cleared.push_back(prev.bit_rank(bit_index));
 			}
 		}
 
-		auto result = std::make_unique<mph_type>(hasher_, sizes, std::move(bitset));
+		// The keys to walk through the leading levels: the added keys,
+		// the extra keys and the keys they evict.
+		struct pending_key
+		{
+			key_type key;
+			std::size_t level;
+		};
+		std::vector<pending_key> pending;
+		for (const auto &item : ranks)
+			pending.push_back({item.first, 0});
+		std::vector<key_type> new_keys;
+		for (const auto &key : added) {
+			std::size_t rank;
+			if (!removed_keys.count(key) && is_member(key, rank))
+				continue;
+			if (ranks.count(key) || !keys_.insert(key).second)
+				continue;
+			pending.push_back({key, 0});
+			new_keys.push_back(key);
+		}
+
+		// Find the trailing levels to rebuild and collect their keys. The
+		// levels in the second half are always rebuilt so that repeated
+		// updates do not use up all the levels.
+		std::size_t tail_level = nlevels;
+		std::size_t tail_keys = 0;
+		while (tail_level > 1) {
+			std::size_t n = 0;
+			for (auto i = level_bases[tail_level - 1] / 64; i < level_bases[tail_level] / 64;
+			     i++)
+				n += __builtin_popcountll(words[i]);
+			if (tail_keys + n > 2 * pending.size() && tail_level <= count / 2)
+				break;
+			tail_keys += n;
+			tail_level--;
+		}
+		for (auto i = level_bases[tail_level] / 64; i < rank_space / 64; i++) {
+			for (auto word = words[i]; word != 0; word &= word - 1)
+				keys_.insert(clear_bit(i * 64 + __builtin_ctzll(word)));
+		}
+
+		for (std::size_t i = 0; i < pending.size(); i++) {
+			auto key = pending[i].key;
+			for (std::size_t level = pending[i].level; level < tail_level; level++) {
+				auto hash = hasher_(key, level);
+				auto bit_index = level_bases[level] + (hash & (prev_levels[level] - 1));
+
+				// Evict the owner of the bit. It continues from
+				// this level to get marked in the filter.
+				if ((words[bit_index / 64] >> (bit_index % 64)) & 1)
+					pending.push_back({clear_bit(bit_index), level});
+				if (level < 2)
+					mark_filter(hash);
+			}
+			keys_.insert(key);
+		}
+
+		// Place the pending keys to the trailing levels.
+		std::array<std::size_t, count> sizes{{0}};
+		std::copy(prev_levels.begin(), prev_levels.begin() + tail_level, sizes.begin());
+		std::vector<bool> level_bits[count];
+		std::vector<std::pair<std::size_t, key_type>> placed;
+		std::size_t level_base = level_bases[tail_level];
+		for (std::size_t level = tail_level; level < count && !keys_.empty(); level++) {
+			fill_level(level, level_bits[level]);
+			place_level(
+				level, level_bits[level],
+				[&](std::size_t index, const key_type &key) {
+					placed.emplace_back(level_base + index, key);
+				},
+				[&](std::uint64_t hash) {
+					if (level < 2)
+						mark_filter(hash);
+				});
+			sizes[level] = level_bits[level].size();
+			level_base += sizes[level];
+		}
+		std::sort(placed.begin(), placed.end(),
+			  [](const auto &a, const auto &b) { return a.first < b.first; });
+		std::sort(cleared.begin(), cleared.end());
+#if PHF_DEBUG > 0
+		std::cerr << "update: " << tail_level << '/' << nlevels << " levels kept, "
+			  << pending.size() << " pending, " << tail_keys << " tail, "
+			  << placed.size() << " placed, " << keys_.size() << " extra\n";
+#endif
+
+		// Assign the external ranks to the added keys.
+		const std::size_t new_size = old_size - holes.size() + new_keys.size();
+		std::sort(holes.begin(), holes.end());
+		std::size_t next_hole = 0;
+		std::size_t next_rank = old_size;
+		auto assign_rank = [&](const key_type &key) {
+			auto it = ranks.find(key);
+			if (it != ranks.end())
+				return it->second;
+			return next_hole < holes.size() ? holes[next_hole++] : next_rank++;
+		};
+
+		// Drop the cleared ranks from the old rank runs and add the ranks
+		// of the placed keys.
+		std::vector<remap_entry> old_runs = prev.remap();
+		if (old_runs.empty())
+			old_runs.push_back({0, 0});
+		std::vector<remap_entry> runs;
+		auto add_run = [&](std::size_t internal, std::size_t external) {
+			append_run(runs, internal, external);
+		};
+		std::size_t c = 0;
+		for (std::size_t j = 0; j < old_runs.size(); j++) {
+			std::size_t start = old_runs[j].internal;
+			std::size_t end =
+				j + 1 < old_runs.size() ? old_runs[j + 1].internal : prev_internal;
+			for (std::size_t pos = start; pos < end;) {
+				if (c < cleared.size() && cleared[c] == pos) {
+					c++;
+					pos++;
+					continue;
+				}
+				std::size_t next = end;
+				if (c < cleared.size() && cleared[c] < end)
+					next = cleared[c];
+				add_run(pos - c, old_runs[j].external + (pos - start));
+				pos = next;
+			}
+		}
+		const std::size_t kept = prev_internal - cleared.size();
+		for (std::size_t i = 0; i < placed.size(); i++)
+			add_run(kept + i, assign_rank(placed[i].second));
+		std::unordered_map<key_type, std::size_t> extra;
 		for (const auto &key : keys_)
-			result->insert(key);
+			extra.emplace(key, assign_rank(key));
+
+		// Move the ranks beyond the new size to the free ones.
+		std::vector<std::size_t> free_ranks;
+		for (; next_hole < holes.size() && holes[next_hole] < new_size; next_hole++)
+			free_ranks.push_back(holes[next_hole]);
+		if (!free_ranks.empty()) {
+			std::size_t f = 0;
+			auto move_rank = [&](std::size_t rank) {
+				auto to = free_ranks[f++];
+				if (moved)
+					moved->emplace_back(rank, to);
+				return to;
+			};
+			std::vector<remap_entry> split;
+			split.swap(runs);
+			const std::size_t total = kept + placed.size();
+			for (std::size_t j = 0; j < split.size(); j++) {
+				std::size_t start = split[j].internal;
+				std::size_t end = j + 1 < split.size() ? split[j + 1].internal : total;
+				std::size_t external = split[j].external;
+				if (external < new_size)
+					add_run(start, external);
+				for (auto pos = start + std::max(external, new_size) - external;
+				     pos < end; pos++)
+					add_run(pos, move_rank(external + (pos - start)));
+			}
+			for (auto &item : extra) {
+				if (item.second >= new_size)
+					item.second = move_rank(item.second);
+			}
+		}
+		if (runs.size() == 1 && runs[0].internal == 0 && runs[0].external == 0)
+			runs.clear();
+
+		std::size_t max_runs = 0;
+		if (remap_limit_ != 0)
+			max_runs = std::max<std::size_t>(new_size * remap_limit_,
+							 min_remap_runs);
+		if (runs.size() > max_runs) {
+			if (moved)
+				moved->resize(nmoved);
+			hasher_ = saved_hasher;
+			keys_.swap(saved_keys);
+			return rebuild(prev, keys_by_rank, holes, new_keys, max_runs / 2,
+				       moved);
+		}
 
+		// Compose the bitset: the kept and new levels, the filter and the
+		// fingerprints of the kept and new keys.
+		std::size_t total_size = level_base + filter_size;
+		total_size += (kept + placed.size()) * fingerprint_bits;
+
+		bitset_type bitset(bits::nwords(total_size));
+		std::copy(words.begin(), words.begin() + level_bases[tail_level] / 64,
+			  bitset.begin());
+		std::size_t bit_index = level_bases[tail_level];
+		for (std::size_t level = tail_level; level < count; level++) {
+			for (std::size_t index = 0; index < sizes[level]; index++, bit_index++) {
+				if (level_bits[level][index])
+					bitset[bit_index / 64] |= UINT64_C(1) << (bit_index % 64);
+			}
+		}
+		std::copy(filter.begin(), filter.end(), bitset.begin() + bit_index / 64);
+		bit_index += filter_size;
+		if (fingerprint_bits != 0) {
+			std::size_t offset = rank_space + filter_size;
+			c = 0;
+			for (std::size_t rank = 0; rank < prev_internal; rank++) {
+				if (c < cleared.size() && cleared[c] == rank) {
+					c++;
+					continue;
+				}
+				auto value = bits::get(prev_bitset, offset + rank * fingerprint_bits,
+						       fingerprint_bits);
+				bits::put(bitset, bit_index, fingerprint_bits, value);
+				bit_index += fingerprint_bits;
+			}
+			for (const auto &p : placed) {
+				auto value = mph_type::fingerprint(hasher_(p.second, 0), fingerprint_bits);
+				bits::put(bitset, bit_index, fingerprint_bits, value);
+				bit_index += fingerprint_bits;
+			}
+		}
+
+		auto result = std::make_unique<mph_type>(hasher_, sizes, std::move(bitset),
+							 fingerprint_bits, std::move(runs));
+		update_prefilter(prev, new_keys, *result);
+		for (const auto &item : extra)
+			result->insert_extra(item.first, item.second);
+
+		hasher_ = saved_hasher;
+		keys_.swap(saved_keys);
 		return result;
 	}
 
@@ -134,9 +597,188 @@ public:
 	{
 		hasher_ = hasher_type(seed_);
 		keys_.clear();
+		weights_.clear();
 	}
 
 private:
+	// The callback of build() that ignores the ranks.
+	struct no_ranks
+	{
+		void operator()(const key_type &, std::size_t) const
+		{
+		}
+	};
+
+	// The rank directory of a level bitset. It gives the number of the
+	// set bits before a given one.
+	class rank_directory
+	{
+	public:
+		rank_directory() = default;
+
+		explicit rank_directory(const std::vector<bool> &bits)
+			: words_((bits.size() + 63) / 64), counts_(words_.size())
+		{
+			for (std::size_t i = 0; i < bits.size(); i++) {
+				if (bits[i])
+					words_[i / 64] |= UINT64_C(1) << (i % 64);
+			}
+			for (std::size_t i = 0; i < words_.size(); i++) {
+				counts_[i] = size_;
+				size_ += __builtin_popcountll(words_[i]);
+			}
+		}
+
+		std::size_t operator()(std::size_t index) const
+		{
+			auto mask = (UINT64_C(1) << (index % 64)) - 1;
+			return counts_[index / 64] + __builtin_popcountll(words_[index / 64] & mask);
+		}
+
+		// The total number of the set bits.
+		std::size_t size() const
+		{
+			return size_;
+		}
+
+	private:
+		std::vector<std::uint64_t> words_;
+		std::vector<std::size_t> counts_;
+		std::size_t size_ = 0;
+	};
+
+	// Add a rank to the remap table runs unless it continues the last run.
+	static void append_run(std::vector<typename mph_type::remap_entry> &runs,
+			       std::size_t internal, std::size_t external)
+	{
+		if (!runs.empty()
+		    && runs.back().external + (internal - runs.back().internal) == external)
+			return;
+		runs.push_back({internal, external});
+	}
+
+	//
+	// Build the function for the updated key set anew with the hasher and
+	// the fingerprint size of the previous one. The old ranks in the new
+	// bitset order form about as many runs as the updates left, so the
+	// keys keep them only in the longest runs, as many as fit the given
+	// number of the remap table runs. Each kept run might take three of
+	// them: its own, the one of the renumbered keys after it and a break
+	// of the free ranks that they take. The other keys take the free
+	// ranks in the bitset order continuing the run of the previous key
+	// where they can, and their rank changes are reported as moves.
+	//
+	template <typename KeysByRank>
+	std::unique_ptr<mph_type>
+	rebuild(const mph_type &prev, const KeysByRank &keys_by_rank,
+		const std::vector<std::size_t> &holes, const std::vector<key_type> &added,
+		std::size_t max_runs, std::vector<std::pair<std::size_t, std::size_t>> *moved)
+	{
+		using remap_entry = typename mph_type::remap_entry;
+		const std::size_t old_size = prev.size();
+		const std::size_t new_size = old_size - holes.size() + added.size();
+
+		builder fresh(gamma_, seed_, prev.fingerprint_bits(), seed_trials_);
+		fresh.hasher_ = prev.key_hasher();
+		fresh.keys_.reserve(new_size);
+		std::vector<bool> removed(old_size);
+		for (auto rank : holes)
+			removed[rank] = true;
+		for (std::size_t rank = 0; rank < old_size; rank++) {
+			if (!removed[rank])
+				fresh.keys_.insert(keys_by_rank[rank]);
+		}
+		fresh.keys_.insert(added.begin(), added.end());
+		auto built = fresh.build();
+
+		// The old ranks in the bitset order of the new function followed
+		// by those of its extra keys. The lookups in the new function are
+		// cheaper than in the old one as it has no remap table.
+		std::vector<std::size_t> old_ranks(new_size, not_found);
+		for (std::size_t rank = 0; rank < old_size; rank++) {
+			if (!removed[rank])
+				old_ranks[(*built)[keys_by_rank[rank]]] = rank;
+		}
+
+		// The runs of the old ranks that might be kept as (length, start).
+		const std::size_t nplaced = new_size - built->extra_keys().size();
+		std::vector<std::pair<std::size_t, std::size_t>> old_runs;
+		for (std::size_t i = 0; i < nplaced; i++) {
+			if (old_ranks[i] >= new_size)
+				continue;
+			if (i != 0 && old_ranks[i - 1] < new_size
+			    && old_ranks[i] == old_ranks[i - 1] + 1)
+				old_runs.back().first++;
+			else
+				old_runs.emplace_back(1, i);
+		}
+		auto nkept = std::min(old_runs.size(), max_runs / 3);
+		std::nth_element(old_runs.begin(), old_runs.begin() + nkept, old_runs.end(),
+				 std::greater<std::pair<std::size_t, std::size_t>>());
+
+		std::vector<bool> keep(new_size);
+		std::vector<bool> taken(new_size);
+		for (std::size_t j = 0; j < nkept; j++) {
+			for (std::size_t n = 0; n < old_runs[j].first; n++)
+				keep[old_runs[j].second + n] = true;
+		}
+		// The extra keys keep their ranks as they are stored with them.
+		for (std::size_t i = nplaced; i < new_size; i++)
+			keep[i] = old_ranks[i] < new_size;
+		for (std::size_t i = 0; i < new_size; i++) {
+			if (keep[i])
+				taken[old_ranks[i]] = true;
+		}
+
+		std::size_t next_free = 0;
+		std::size_t last = not_found;
+		auto new_rank = [&](std::size_t i) {
+			if (keep[i])
+				return last = old_ranks[i];
+			auto rank = last + 1;
+			if (last == not_found || rank == new_size || taken[rank]) {
+				while (taken[next_free])
+					next_free++;
+				rank = next_free;
+			}
+			taken[rank] = true;
+			if (moved && old_ranks[i] != not_found && old_ranks[i] != rank)
+				moved->emplace_back(old_ranks[i], rank);
+			return last = rank;
+		};
+		std::vector<remap_entry> runs;
+		for (std::size_t i = 0; i < nplaced; i++)
+			append_run(runs, i, new_rank(i));
+		if (runs.size() == 1 && runs[0].internal == 0 && runs[0].external == 0)
+			runs.clear();
+
+		auto result = std::make_unique<mph_type>(
+			built->key_hasher(), built->levels(), bitset_type(built->bitset()),
+			built->fingerprint_bits(), std::move(runs));
+		for (const auto &item : built->extra_keys())
+			result->insert_extra(item.first, new_rank(item.second));
+		update_prefilter(prev, added, *result);
+
+#if PHF_DEBUG > 0
+		std::cerr << "update: rebuilt, " << result->remap().size() << " runs, "
+			  << (moved ? moved->size() : 0) << " moved\n";
+#endif
+		return result;
+	}
+
+	// Carry the prefilter of the previous function over to the updated
+	// one. The removed keys stay in it as false positives.
+	static void update_prefilter(const mph_type &prev, const std::vector<key_type> &added,
+				     mph_type &result)
+	{
+		if (prev.prefilter().empty())
+			return;
+		blocked_bloom prefilter = prev.prefilter();
+		for (const auto &key : added)
+			prefilter.insert(prev.key_hasher()(key, 0));
+		result.set_prefilter(std::move(prefilter));
+	}
+
 	std::size_t power_of_two(std::size_t n)
 	{
 		unsigned long long s = n ? n : 2;
@@ -144,6 +786,30 @@ private:
 		return (size_t{1} << nbits);
 	}
 
+	// Remove the keys that fit the level without conflicts from the key
+	// set. The callbacks are called with the bit index for a placed key
+	// and with the level hash value for a conflicting one.
+	template <typename Place, typename Conflict>
+	void place_level(std::size_t level, const std::vector<bool> &bitset, Place on_place,
+			 Conflict on_conflict)
+	{
+		auto it = keys_.begin();
+		auto size = bitset.size();
+		while (it != keys_.end()) {
+			hasher_ = *it;
+			auto hash = hasher_[level];
+			std::size_t index = hash & (size - 1);
+
+			if (bitset[index]) {
+				on_place(index, *it);
+				keys_.erase(it++);
+			} else {
+				++it;
+				on_conflict(hash);
+			}
+		}
+	}
+
 	void fill_level(size_t level, std::vector<bool> &bitset)
 	{
 		// Compute the required bitset size.
@@ -176,14 +842,72 @@ private:
 		}
 	}
 
+	// Fill the level with the seed that places the most key weight out
+	// of several ones. The chosen seed replaces the level seed of the
+	// hasher. The first seed tried is the original one.
+	void fill_weighted_level(std::size_t level, std::vector<bool> &bitset)
+	{
+		auto seeds = hasher_.seeds();
+		rng::rng128 rng(seeds[level]);
+
+		double best_weight = -1;
+		auto best_seed = seeds[level];
+		std::vector<bool> best_bitset;
+		for (unsigned trial = 0; trial < seed_trials_; trial++) {
+			if (trial != 0) {
+				seeds[level] = rng();
+				hasher_ = hasher_type(seeds);
+			}
+			fill_level(level, bitset);
+
+			double weight = 0;
+			for (const auto &key : keys_) {
+				if (bitset[hasher_(key, level) & (bitset.size() - 1)])
+					weight += key_weight(key);
+			}
+			if (weight > best_weight) {
+				best_weight = weight;
+				best_seed = seeds[level];
+				best_bitset.swap(bitset);
+			}
+		}
+#if PHF_DEBUG > 0
+		std::cerr << "level " << level << " seed " << std::hex << best_seed << std::dec
+			  << " weight " << best_weight << '\n';
+#endif
+		seeds[level] = best_seed;
+		hasher_ = hasher_type(seeds);
+		bitset.swap(best_bitset);
+	}
+
+	double key_weight(const key_type &key) const
+	{
+		auto it = weights_.find(key);
+		return it == weights_.end() ? 1.0 : it->second;
+	}
+
 	// The gamma parameter gamma specifies how many bits per key are
 	// allocated on a given bitset level.
 	const double gamma_;
 
 	const std::uint64_t seed_;
+
+	// The number of fingerprint bits per key or zero.
+	const unsigned fingerprint_bits_;
+
+	// The number of seeds tried for each level of a weighted key set.
+	const unsigned seed_trials_;
+
+	// The false positive rate of the prefilter or zero.
+	double prefilter_rate_ = 0;
+
+	// The limit of the rank remap table runs per key for the update.
+	double remap_limit_ = default_remap_limit;
+
 	hasher_type hasher_;
 
 	std::unordered_set<key_type> keys_;
+	std::unordered_map<key_type, double> weights_;
 };
 
 } // namespace phf
@@ -0,0 +1,315 @@
+#ifndef PERFECT_HASH_COMPOSITE_H
+#define PERFECT_HASH_COMPOSITE_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "bits.h"
+#include "fragments.h"
+
+namespace phf {
+
+//
+// A non-owning view of a byte sequence. It hashes the same as a string
+// with the same contents so it might be used to look up a string field
+// of a composite key without a copy.
+//
+struct byte_span
+{
+	const char *data;
+	std::size_t size;
+
+	constexpr byte_span() : data(nullptr), size(0)
+	{
+	}
+
+	byte_span(const void *data, std::size_t size)
+		: data(static_cast<const char *>(data)), size(size)
+	{
+	}
+
+	template <typename T, typename A>
+	byte_span(const std::basic_string<char, T, A> &string)
+		: data(string.data()), size(string.size())
+	{
+	}
+
+	byte_span(const char *string) : data(string), size(std::strlen(string))
+	{
+	}
+
+	operator std::string() const
+	{
+		return std::string(data, size);
+	}
+};
+
+static inline bool
+operator==(const byte_span &a, const byte_span &b)
+{
+	return a.size == b.size && (a.size == 0 || std::memcmp(a.data, b.data, a.size) == 0);
+}
+
+static inline bool
+operator!=(const byte_span &a, const byte_span &b)
+{
+	return !(a == b);
+}
+
+static inline std::ostream &
+operator<<(std::ostream &os, const byte_span &span)
+{
+	return os.write(span.data, span.size);
+}
+
+//
+// A key made of several fields. It is a tuple that has a std::hash
+// specialization so it might be used as a key of the builders directly
+// with composite_hash as the hasher:
+//
+//   using key = phf::composite<std::uint64_t, std::string, std::uint16_t>;
+//   phf::builder<16, key, phf::composite_hash> builder(2, seed);
+//   builder.insert(key(tenant, name, type));
+//   ...
+//   auto rank = mph->find(phf::composite<std::uint64_t, phf::byte_span,
+//                                        std::uint16_t>(tenant, name, type));
+//
+// The lookup with byte_span fields hashes the same and does not copy the
+// strings.
+//
+template <typename... Fields>
+struct composite : std::tuple<Fields...>
+{
+	using std::tuple<Fields...>::tuple;
+
+	composite() = default;
+
+	// Convert a composite with compatible fields such as a view one.
+	template <typename... Others>
+	explicit composite(const composite<Others...> &other)
+		: std::tuple<Fields...>(static_cast<const std::tuple<Others...> &>(other))
+	{
+	}
+};
+
+template <typename Tuple, std::size_t... I>
+void
+print_fields(std::ostream &os, const Tuple &fields, std::index_sequence<I...>)
+{
+	(void) std::initializer_list<int>{(os << (I ? ", " : "") << std::get<I>(fields), 0)...};
+}
+
+template <typename... Fields>
+std::ostream &
+operator<<(std::ostream &os, const composite<Fields...> &key)
+{
+	os << '(';
+	print_fields(os, key, std::index_sequence_for<Fields...>());
+	return os << ')';
+}
+
+//
+// Template utility that checks if a given type provides a method that
+// returns its fields as a tuple, normally of references with std::tie().
+//
+template <typename T>
+using fields_t = decltype(std::declval<const T &>().fields());
+
+//
+// A seeded hasher that streams over the fields of a composite key rather
+// than over a concatenated buffer. It supports:
+//
+// * integer and enum values,
+// * strings and byte spans,
+// * tuples, pairs and composites of the supported types,
+// * structs with a fields() method that returns a tuple of them,
+// * arrays and vectors of byte spans and fragments, that is scatter lists
+//   that hash the same as the string with their contents concatenated.
+//
+// Each string is hashed along with its length so the boundaries between
+// the fields matter.
+//
+struct composite_hash
+{
+	using result_type = std::uint64_t;
+
+	static constexpr std::uint64_t multiplier = UINT64_C(0x9E3779B97F4A7C15);
+
+	template <typename T>
+	result_type operator()(const T &key, std::uint64_t seed) const
+	{
+		state s(seed);
+		add(s, key);
+		return s.finish();
+	}
+
+private:
+	// The hash state that consumes whole words and buffers the trailing
+	// bytes of a byte sequence.
+	class state
+	{
+	public:
+		explicit state(std::uint64_t seed) : hash_(seed)
+		{
+		}
+
+		void word(std::uint64_t value)
+		{
+			hash_ = bits::mix(hash_ ^ value) * multiplier;
+		}
+
+		void bytes(const char *data, std::size_t size)
+		{
+			if (nbuffered_ != 0) {
+				std::size_t n = std::min(size, 8 - nbuffered_);
+				std::memcpy(buffer_ + nbuffered_, data, n);
+				nbuffered_ += n;
+				data += n;
+				size -= n;
+				if (nbuffered_ < 8)
+					return;
+				flush();
+			}
+			for (; size >= 8; size -= 8, data += 8) {
+				std::uint64_t value;
+				std::memcpy(&value, data, 8);
+				word(value);
+			}
+			std::memcpy(buffer_, data, size);
+			nbuffered_ = size;
+		}
+
+		// Finish a byte sequence.
+		void flush()
+		{
+			if (nbuffered_ == 0)
+				return;
+			std::uint64_t value = 0;
+			std::memcpy(&value, buffer_, nbuffered_);
+			nbuffered_ = 0;
+			word(value);
+		}
+
+		std::uint64_t finish()
+		{
+			return bits::mix(hash_);
+		}
+
+	private:
+		std::uint64_t hash_;
+		char buffer_[8];
+		std::size_t nbuffered_ = 0;
+	};
+
+	template <typename T, std::enable_if_t<std::is_integral<T>::value, int> = 0>
+	static void add(state &s, T value)
+	{
+		s.word(static_cast<std::uint64_t>(value));
+	}
+
+	template <typename T, std::enable_if_t<std::is_enum<T>::value, int> = 0>
+	static void add(state &s, T value)
+	{
+		s.word(static_cast<std::uint64_t>(value));
+	}
+
+	static void add(state &s, const byte_span &span)
+	{
+		s.word(span.size);
+		s.bytes(span.data, span.size);
+		s.flush();
+	}
+
+	template <typename T, typename A>
+	static void add(state &s, const std::basic_string<char, T, A> &string)
+	{
+		add(s, byte_span(string));
+	}
+
+	template <typename Spans>
+	static void add_spans(state &s, const Spans &spans)
+	{
+		std::size_t size = 0;
+		for (const auto &span : spans)
+			size += span.size;
+		s.word(size);
+		for (const auto &span : spans)
+			s.bytes(span.data, span.size);
+		s.flush();
+	}
+
+	template <std::size_t N>
+	static void add(state &s, const std::array<byte_span, N> &spans)
+	{
+		add_spans(s, spans);
+	}
+
+	template <typename A>
+	static void add(state &s, const std::vector<byte_span, A> &spans)
+	{
+		add_spans(s, spans);
+	}
+
+	static void add(state &s, const fragments &key)
+	{
+		s.word(key.size());
+		key.for_each_word([&s](std::uint64_t value) { s.word(value); });
+	}
+
+	template <typename Tuple, std::size_t... I>
+	static void add_fields(state &s, const Tuple &fields, std::index_sequence<I...>)
+	{
+		(void) std::initializer_list<int>{(add(s, std::get<I>(fields)), 0)...};
+	}
+
+	template <typename... Fields>
+	static void add(state &s, const std::tuple<Fields...> &fields)
+	{
+		add_fields(s, fields, std::index_sequence_for<Fields...>());
+	}
+
+	template <typename First, typename Second>
+	static void add(state &s, const std::pair<First, Second> &fields)
+	{
+		add(s, fields.first);
+		add(s, fields.second);
+	}
+
+	template <typename... Fields>
+	static void add(state &s, const composite<Fields...> &fields)
+	{
+		add(s, static_cast<const std::tuple<Fields...> &>(fields));
+	}
+
+	template <typename T, typename = fields_t<T>>
+	static void add(state &s, const T &key)
+	{
+		add(s, key.fields());
+	}
+};
+
+} // namespace phf
+
+namespace std {
+
+template <typename... Fields>
+struct hash<phf::composite<Fields...>>
+{
+	std::size_t operator()(const phf::composite<Fields...> &key) const
+	{
+		return phf::composite_hash()(key, 0);
+	}
+};
+
+} // namespace std
+
+#endif // PERFECT_HASH_COMPOSITE_H
@@ -0,0 +1,227 @@
+#ifndef PERFECT_HASH_CONSTEXPR_MPH_H
+#define PERFECT_HASH_CONSTEXPR_MPH_H
+
+#include <cstdint>
+#include <stdexcept>
+
+#include "bits.h"
+#include "hasher.h"
+
+namespace phf {
+
+//
+// A minimal perfect hash function for a small fixed set of strings that
+// is built during compilation. It maps each string to its index in the
+// list it was built from, for instance to dispatch on HTTP header names
+// or configuration keys:
+//
+//   constexpr auto headers = phf::make_constexpr_mph("accept", "host", "via");
+//   switch (headers.find(name)) {
+//   case 0: ...
+//   case phf::not_found: ...
+//   }
+//
+// It uses the hash and displace method. The keys are split into buckets
+// by the hash value and each bucket gets a pilot value that mixed with
+// the hash values of its keys gives distinct positions. The largest
+// buckets are placed first. The position is then mapped to the key index
+// and the key is compared with the stored one. So a lookup takes one
+// hash, two table loads and a string comparison.
+//
+// The build is done by the compiler so it is meant for up to a few
+// hundred keys. With many keys the compiler might hit its limit for the
+// constant expression evaluation steps. A build failure, for instance
+// because of duplicate keys, is reported as a compilation error.
+//
+template <std::size_t N>
+class constexpr_mph
+{
+	static_assert(N > 0, "the key set must not be empty");
+
+public:
+	static constexpr std::size_t nbuckets = (N + 1) / 2;
+
+	// Give up on the current seed if any pilot exceeds this limit.
+	static constexpr std::uint32_t max_pilot = 1 << 16;
+	// Give up the build after this many seeds.
+	static constexpr std::size_t max_attempts = 16;
+
+	constexpr constexpr_mph(const char *const (&keys)[N], const std::size_t (&lengths)[N])
+		: keys_{}, lengths_{}, seed_(0), pilots_{}, indices_{}
+	{
+		for (std::size_t i = 0; i < N; i++) {
+			keys_[i] = keys[i];
+			lengths_[i] = lengths[i];
+			for (std::size_t j = 0; j < i; j++) {
+				if (equal(keys[i], lengths[i], keys[j], lengths[j]))
+					throw std::invalid_argument("duplicate key");
+			}
+		}
+
+		for (std::size_t attempt = 0; attempt < max_attempts; attempt++) {
+			seed_ = bits::mix(attempt + 1);
+			if (try_build())
+				return;
+		}
+		throw std::runtime_error("failed to build the hash function");
+	}
+
+	static constexpr std::size_t size()
+	{
+		return N;
+	}
+
+	// Find the index of a key or not_found if there is no such key.
+	constexpr std::size_t find(const char *data, std::size_t size) const
+	{
+		auto index = operator()(data, size);
+		return equal(keys_[index], lengths_[index], data, size) ? index : not_found;
+	}
+
+	template <std::size_t L>
+	constexpr std::size_t find(const char (&key)[L]) const
+	{
+		return find(key, L - 1);
+	}
+
+	// Find the index of a key given as a string or a string view. Other
+	// types do not match this overload.
+	template <typename String>
+	constexpr auto find(const String &key) const
+		-> decltype(static_cast<const char *>(key.data()), std::size_t(key.size()))
+	{
+		return find(key.data(), key.size());
+	}
+
+	// Get the index of a key without checking that it is in the set.
+	constexpr std::size_t operator()(const char *data, std::size_t size) const
+	{
+		auto hash = hash_key(data, size, seed_);
+		return indices_[position(hash, pilots_[bucket(hash)])];
+	}
+
+	constexpr const char *key(std::size_t index) const
+	{
+		return keys_[index];
+	}
+
+	constexpr std::size_t key_size(std::size_t index) const
+	{
+		return lengths_[index];
+	}
+
+private:
+	const char *keys_[N];
+	std::size_t lengths_[N];
+
+	std::uint64_t seed_;
+	std::uint32_t pilots_[nbuckets];
+	std::uint32_t indices_[N];
+
+	// The FNV-1a hash seeded and finalized with a mixer.
+	static constexpr std::uint64_t hash_key(const char *data, std::size_t size,
+						std::uint64_t seed)
+	{
+		std::uint64_t hash = UINT64_C(0xcbf29ce484222325) ^ seed;
+		for (std::size_t i = 0; i < size; i++) {
+			hash ^= static_cast<unsigned char>(data[i]);
+			hash *= UINT64_C(0x100000001b3);
+		}
+		return bits::mix(hash);
+	}
+
+	static constexpr std::size_t bucket(std::uint64_t hash)
+	{
+		return bits::reduce32(hash >> 32, nbuckets);
+	}
+
+	static constexpr std::size_t position(std::uint64_t hash, std::uint32_t pilot)
+	{
+		return bits::reduce32(bits::mix(hash ^ pilot), N);
+	}
+
+	static constexpr bool equal(const char *a, std::size_t a_size, const char *b,
+				    std::size_t b_size)
+	{
+		if (a_size != b_size)
+			return false;
+		for (std::size_t i = 0; i < a_size; i++) {
+			if (a[i] != b[i])
+				return false;
+		}
+		return true;
+	}
+
+	constexpr bool try_build()
+	{
+		// Sort the keys by bucket.
+		std::uint64_t hashes[N] = {};
+		std::size_t starts[nbuckets + 1] = {};
+		for (std::size_t i = 0; i < N; i++) {
+			hashes[i] = hash_key(keys_[i], lengths_[i], seed_);
+			starts[bucket(hashes[i]) + 1]++;
+		}
+		std::size_t max_bucket_size = 0;
+		for (std::size_t b = 0; b < nbuckets; b++) {
+			if (starts[b + 1] > max_bucket_size)
+				max_bucket_size = starts[b + 1];
+			starts[b + 1] += starts[b];
+		}
+		std::size_t sorted[N] = {};
+		std::size_t fill[nbuckets] = {};
+		for (std::size_t i = 0; i < N; i++) {
+			auto b = bucket(hashes[i]);
+			sorted[starts[b] + fill[b]++] = i;
+		}
+
+		// Place the buckets from the largest ones.
+		bool taken[N] = {};
+		std::size_t positions[N] = {};
+		for (std::size_t size = max_bucket_size; size > 0; size--) {
+			for (std::size_t b = 0; b < nbuckets; b++) {
+				if (starts[b + 1] - starts[b] != size)
+					continue;
+
+				std::uint32_t pilot = 0;
+				for (;; pilot++) {
+					if (pilot == max_pilot)
+						return false;
+
+					bool ok = true;
+					for (std::size_t k = 0; ok && k < size; k++) {
+						auto p = position(hashes[sorted[starts[b] + k]], pilot);
+						ok = !taken[p];
+						for (std::size_t j = 0; ok && j < k; j++)
+							ok = positions[j] != p;
+						positions[k] = p;
+					}
+					if (ok)
+						break;
+				}
+
+				pilots_[b] = pilot;
+				for (std::size_t k = 0; k < size; k++) {
+					taken[positions[k]] = true;
+					indices_[positions[k]] = sorted[starts[b] + k];
+				}
+			}
+		}
+		return true;
+	}
+};
+
+//
+// Build a function for the given string literals.
+//
+template <std::size_t... L>
+constexpr constexpr_mph<sizeof...(L)>
+make_constexpr_mph(const char (&... keys)[L])
+{
+	const char *const key_array[] = {keys...};
+	const std::size_t length_array[] = {(L - 1)...};
+	return constexpr_mph<sizeof...(L)>(key_array, length_array);
+}
+
+} // namespace phf
+
+#endif // PERFECT_HASH_CONSTEXPR_MPH_H
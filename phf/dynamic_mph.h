@@ -0,0 +1,551 @@
+#ifndef PERFECT_HASH_DYNAMIC_MPH_H
+#define PERFECT_HASH_DYNAMIC_MPH_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bits.h"
+#include "builder.h"
+#include "hasher.h"
+#include "mph.h"
+#include "table_handle.h"
+
+namespace phf {
+
+//
+// A hash function object for a changing key set. It combines an immutable
+// minimal perfect hash function for the bulk of the keys with a delta of
+// inserted keys and erased ranks. When the delta grows beyond a threshold
+// the function for the whole key set is rebuilt on a background thread
+// and swapped in.
+//
+// The delta is updated in place by the writers with atomic stores that
+// the readers observe as they happen, so a change costs about the same
+// as an insert to a hash table. The objects the writers replace are freed
+// after a grace period, and the rebuilt versions are swapped in through
+// a table_handle. So the readers take no locks and do no atomic
+// read-modify-write operations. Each reader thread registers a reader
+// object and from time to time passes through a quiescent state, see
+// table_handle for details. As the writers might wait for a grace period
+// a thread must not have an online reader while it makes changes.
+//
+// The rank of a key stays the same until a rebuild. A rebuild assigns the
+// ranks from 0 to size() - 1 anew and increments the generation number.
+// Between rebuilds erased keys leave holes in the rank space and inserted
+// keys get the ranks from rank_bound() upwards.
+//
+template <std::size_t N, typename Key, typename Hash = std::hash<Key>>
+class dynamic_mph
+{
+public:
+	using key_type = Key;
+	using base_hasher_type = Hash;
+	using builder_type = builder<N, key_type, base_hasher_type>;
+	using mph_type = typename builder_type::mph_type;
+	using rank_type = typename mph_type::rank_type;
+
+	// The number of replaced objects kept before a grace period is waited
+	// for to free them.
+	static constexpr std::size_t reclaim_batch = 1024;
+
+	//
+	// A version of the object from one rebuild to the next one.
+	//
+	class version
+	{
+	public:
+		version() = default;
+
+		version(const version &) = delete;
+		version &operator=(const version &) = delete;
+
+		~version()
+		{
+			auto *delta = delta_.load(std::memory_order_relaxed);
+			if (delta) {
+				for (std::size_t i = 0; i <= delta->mask; i++)
+					delete delta->slots[i].load(std::memory_order_relaxed);
+				delete delta;
+			}
+		}
+
+		std::size_t operator[](const key_type &key) const
+		{
+			// A key erased from the base might be inserted again.
+			if (base_) {
+				auto rank = base_->mph->operator[](key);
+				if (rank < base_->keys.size() && base_->keys[rank] == key
+				    && !erased(rank))
+					return rank;
+			}
+			auto *e = find(key);
+			return e ? e->rank : not_found;
+		}
+
+		bool contains(const key_type &key) const
+		{
+			return operator[](key) != not_found;
+		}
+
+		std::size_t size() const
+		{
+			return size_.load(std::memory_order_acquire);
+		}
+
+		// An upper bound of the ranks of this version.
+		std::size_t rank_bound() const
+		{
+			return rank_bound_.load(std::memory_order_acquire);
+		}
+
+		// The number of the rebuilds so far.
+		std::size_t generation() const
+		{
+			return generation_;
+		}
+
+		// The number of changes since the last rebuild.
+		std::size_t delta_size() const
+		{
+			return delta_size_.load(std::memory_order_acquire);
+		}
+
+	private:
+		friend class dynamic_mph;
+
+		struct base
+		{
+			std::unique_ptr<mph_type> mph;
+			std::vector<key_type> keys;
+		};
+
+		// An inserted key. An erased one is replaced with an entry that
+		// has the not_found rank. The entries are immutable.
+		struct entry
+		{
+			key_type key;
+			std::size_t rank;
+		};
+
+		// An open addressing table of the inserted keys. The writers
+		// fill the empty slots and replace the entries but never clear
+		// a slot, so the linear probe sequence of a key stays intact.
+		struct delta_table
+		{
+			std::size_t mask;
+			std::unique_ptr<std::atomic<const entry *>[]> slots;
+
+			explicit delta_table(std::size_t capacity)
+				: mask(capacity - 1), slots(new std::atomic<const entry *>[capacity])
+			{
+				for (std::size_t i = 0; i < capacity; i++)
+					slots[i].store(nullptr, std::memory_order_relaxed);
+			}
+		};
+
+		// The rebuilt part.
+		std::shared_ptr<const base> base_;
+
+		// The bits of the erased ranks of the base.
+		std::unique_ptr<std::atomic<std::uint64_t>[]> erased_;
+
+		std::atomic<const delta_table *> delta_{nullptr};
+
+		std::atomic<std::size_t> size_{0};
+		std::atomic<std::size_t> rank_bound_{0};
+		std::atomic<std::size_t> delta_size_{0};
+		std::size_t generation_ = 0;
+
+		// The objects replaced by the writers that the readers might
+		// still use.
+		struct retired
+		{
+			std::vector<std::unique_ptr<const entry>> entries;
+			std::vector<std::unique_ptr<const delta_table>> tables;
+		};
+
+		// The writer state: the number of used delta slots including
+		// those of the erased keys and the replaced objects.
+		std::size_t delta_used_ = 0;
+		retired retired_;
+
+		void set_base(std::shared_ptr<const base> &&b)
+		{
+			base_ = std::move(b);
+			auto nkeys = base_->keys.size();
+			erased_.reset(new std::atomic<std::uint64_t>[bits::nwords(nkeys)]);
+			for (std::size_t i = 0; i < bits::nwords(nkeys); i++)
+				erased_[i].store(0, std::memory_order_relaxed);
+			size_.store(nkeys, std::memory_order_relaxed);
+			rank_bound_.store(nkeys, std::memory_order_relaxed);
+		}
+
+		bool erased(std::size_t rank) const
+		{
+			auto word = erased_[rank / 64].load(std::memory_order_acquire);
+			return (word >> (rank % 64)) & 1;
+		}
+
+		static std::size_t delta_hash(const key_type &key)
+		{
+			return bits::mix(std::hash<key_type>()(key));
+		}
+
+		// Find the slot of a key in the delta table or an empty one.
+		static std::size_t probe(const delta_table &delta, const key_type &key)
+		{
+			auto i = delta_hash(key) & delta.mask;
+			for (;; i = (i + 1) & delta.mask) {
+				auto *e = delta.slots[i].load(std::memory_order_acquire);
+				if (!e || e->key == key)
+					return i;
+			}
+		}
+
+		const entry *find(const key_type &key) const
+		{
+			auto *delta = delta_.load(std::memory_order_acquire);
+			if (!delta)
+				return nullptr;
+			return delta->slots[probe(*delta, key)].load(std::memory_order_acquire);
+		}
+
+		// Collect the current key set.
+		std::vector<key_type> keys() const
+		{
+			std::vector<key_type> result;
+			result.reserve(size());
+			if (base_) {
+				for (std::size_t rank = 0; rank < base_->keys.size(); rank++) {
+					if (!erased(rank))
+						result.push_back(base_->keys[rank]);
+				}
+			}
+			auto *delta = delta_.load(std::memory_order_relaxed);
+			if (delta) {
+				for (std::size_t i = 0; i <= delta->mask; i++) {
+					auto *e = delta->slots[i].load(std::memory_order_relaxed);
+					if (e && e->rank != not_found)
+						result.push_back(e->key);
+				}
+			}
+			return result;
+		}
+
+		std::size_t retired_size() const
+		{
+			return retired_.entries.size() + retired_.tables.size();
+		}
+
+		// Take the replaced objects to free them once the readers are
+		// done with them.
+		retired take_retired()
+		{
+			retired result = std::move(retired_);
+			retired_ = retired();
+			return result;
+		}
+
+		// Put an entry to the delta table replacing the one for the same
+		// key if any. The table grows as needed keeping its load factor
+		// below 1/2. The entries of the erased keys are dropped then.
+		void put(std::unique_ptr<const entry> e)
+		{
+			auto *delta = delta_.load(std::memory_order_relaxed);
+			if (!delta || 2 * (delta_used_ + 1) > delta->mask + 1) {
+				std::size_t live = 0;
+				if (delta) {
+					for (std::size_t i = 0; i <= delta->mask; i++) {
+						auto *x = delta->slots[i].load(std::memory_order_relaxed);
+						if (x && x->rank != not_found)
+							live++;
+					}
+				}
+				std::size_t capacity = 16;
+				while (capacity < 4 * (live + 1))
+					capacity *= 2;
+
+				auto *next = new delta_table(capacity);
+				delta_used_ = 0;
+				if (delta) {
+					for (std::size_t i = 0; i <= delta->mask; i++) {
+						auto *x = delta->slots[i].load(std::memory_order_relaxed);
+						if (!x)
+							continue;
+						if (x->rank == not_found) {
+							retired_.entries.emplace_back(x);
+							continue;
+						}
+						next->slots[probe(*next, x->key)].store(
+							x, std::memory_order_relaxed);
+						delta_used_++;
+					}
+					retired_.tables.emplace_back(delta);
+				}
+				delta_.store(next, std::memory_order_release);
+				delta = next;
+			}
+
+			auto &slot = delta->slots[probe(*delta, e->key)];
+			auto *old = slot.load(std::memory_order_relaxed);
+			slot.store(e.release(), std::memory_order_release);
+			if (old)
+				retired_.entries.emplace_back(old);
+			else
+				delta_used_++;
+		}
+
+		bool insert(const key_type &key)
+		{
+			if (contains(key))
+				return false;
+			auto rank = rank_bound_.load(std::memory_order_relaxed);
+			put(std::unique_ptr<const entry>(new entry{key, rank}));
+			rank_bound_.store(rank + 1, std::memory_order_release);
+			size_.store(size() + 1, std::memory_order_release);
+			delta_size_.store(delta_size() + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool erase(const key_type &key)
+		{
+			auto rank = operator[](key);
+			if (rank == not_found)
+				return false;
+			if (base_ && rank < base_->keys.size()) {
+				auto mask = UINT64_C(1) << (rank % 64);
+				erased_[rank / 64].fetch_or(mask, std::memory_order_release);
+				delta_size_.store(delta_size() + 1, std::memory_order_release);
+			} else {
+				put(std::unique_ptr<const entry>(new entry{key, not_found}));
+				delta_size_.store(delta_size() - 1, std::memory_order_release);
+			}
+			size_.store(size() - 1, std::memory_order_release);
+			return true;
+		}
+	};
+
+	//
+	// A reader of the object. It is used from a single thread as the
+	// table_handle readers are.
+	//
+	class reader : public table_handle<version>::reader
+	{
+	public:
+		explicit reader(dynamic_mph &table) : table_handle<version>::reader(table.handle_)
+		{
+		}
+	};
+
+	//
+	// The rebuild starts when the number of changes since the last one
+	// exceeds both the min_delta value and the delta_ratio fraction of
+	// the key set size.
+	//
+	dynamic_mph(double gamma, std::uint64_t seed, std::size_t min_delta = 1024,
+		    double delta_ratio = 0.125)
+		: gamma_(gamma), seed_(seed), min_delta_(min_delta), delta_ratio_(delta_ratio)
+	{
+		auto first = std::make_unique<version>();
+		current_ = first.get();
+		handle_.publish(std::move(first));
+	}
+
+	// All the readers must be gone by now.
+	~dynamic_mph()
+	{
+		wait();
+	}
+
+	dynamic_mph(const dynamic_mph &) = delete;
+	dynamic_mph &operator=(const dynamic_mph &) = delete;
+
+	// The lookups for the writer threads. The readers use their reader
+	// objects.
+	std::size_t operator[](const key_type &key) const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return current_->operator[](key);
+	}
+
+	bool contains(const key_type &key) const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return current_->contains(key);
+	}
+
+	std::size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return current_->size();
+	}
+
+	bool insert(const key_type &key)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (!current_->insert(key))
+			return false;
+		if (rebuilding_)
+			pending_.emplace_back(key, true);
+		changed(lock);
+		return true;
+	}
+
+	bool erase(const key_type &key)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (!current_->erase(key))
+			return false;
+		if (rebuilding_)
+			pending_.emplace_back(key, false);
+		changed(lock);
+		return true;
+	}
+
+	// Rebuild the function for the current key set and wait for the
+	// result. If a rebuild is already in progress then it is completed
+	// first.
+	void rebuild()
+	{
+		for (bool started = false; !started;) {
+			std::unique_lock<std::mutex> lock(mutex_);
+			if (!rebuilding_ && !retiring_) {
+				start_rebuild(*current_);
+				started = true;
+			}
+			lock.unlock();
+			wait();
+		}
+	}
+
+	// Wait until a background rebuild is over if there is one.
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		rebuilt_.wait(lock, [this] { return !rebuilding_ && !retiring_; });
+		if (worker_.joinable()) {
+			std::thread worker = std::move(worker_);
+			lock.unlock();
+			worker.join();
+		}
+	}
+
+private:
+	using version_base = typename version::base;
+
+	const double gamma_;
+	const std::uint64_t seed_;
+	const std::size_t min_delta_;
+	const double delta_ratio_;
+
+	// The readers get the current version from the handle. The writers
+	// change it through the plain pointer with the mutex locked.
+	table_handle<version> handle_;
+	version *current_;
+
+	// Writers and the rebuild completion are serialized with this mutex.
+	mutable std::mutex mutex_;
+
+	// The background rebuild state. The changes made while a rebuild
+	// is in progress are replayed on top of its result. Then the worker
+	// waits for the readers to leave the old version with the mutex
+	// unlocked, and the next rebuild does not start before it is done.
+	bool rebuilding_ = false;
+	bool retiring_ = false;
+	std::condition_variable rebuilt_;
+	std::vector<std::pair<key_type, bool>> pending_;
+	std::thread worker_;
+
+	// Start a background rebuild if needed and free the replaced objects
+	// in batches. This is called with the mutex locked. The mutex is
+	// unlocked for the grace period so the other writers go on meanwhile.
+	void changed(std::unique_lock<std::mutex> &lock)
+	{
+		if (!rebuilding_ && !retiring_
+		    && current_->delta_size()
+			       > std::max<double>(min_delta_, delta_ratio_ * current_->size()))
+			start_rebuild(*current_);
+		if (current_->retired_size() >= reclaim_batch) {
+			auto retired = current_->take_retired();
+			lock.unlock();
+			handle_.synchronize();
+		}
+	}
+
+	// Start a background rebuild for the key set of the given version.
+	// This is called with the mutex locked. The previous worker thread
+	// if any has already left the locked section so it is joined
+	// without delay.
+	void start_rebuild(const version &from)
+	{
+		rebuilding_ = true;
+		if (worker_.joinable())
+			worker_.join();
+		worker_ = std::thread(&dynamic_mph::run_rebuild, this, from.keys(),
+				      from.generation_ + 1);
+	}
+
+	void run_rebuild(std::vector<key_type> keys, std::size_t generation)
+	{
+		auto base = std::make_shared<version_base>();
+		try {
+			builder_type builder(gamma_, seed_);
+			for (const auto &key : keys)
+				builder.insert(key);
+
+			// Put the keys in the rank order as the builder reports it.
+			base->keys.resize(keys.size());
+			std::vector<key_type>().swap(keys);
+			base->mph = builder.build([&](const key_type &key, std::size_t rank) {
+				base->keys[rank] = key;
+			});
+		} catch (...) {
+			// Keep the current version, the next change retries.
+			std::lock_guard<std::mutex> lock(mutex_);
+			pending_.clear();
+			rebuilding_ = false;
+			rebuilt_.notify_all();
+			return;
+		}
+
+		auto next = std::make_unique<version>();
+		next->set_base(std::move(base));
+		next->generation_ = generation;
+
+		// The new version is swapped in with the mutex locked so the
+		// readers see it before any later change. The old version and
+		// the objects it replaced are freed after the grace period.
+		std::unique_lock<std::mutex> lock(mutex_);
+		for (const auto &change : pending_) {
+			if (change.second)
+				next->insert(change.first);
+			else
+				next->erase(change.first);
+		}
+		pending_.clear();
+		current_ = next.get();
+		auto old = handle_.exchange(std::move(next));
+		rebuilding_ = false;
+		retiring_ = true;
+		lock.unlock();
+
+		handle_.synchronize();
+		old.reset();
+
+		lock.lock();
+		retiring_ = false;
+		rebuilt_.notify_all();
+	}
+};
+
+} // namespace phf
+
+#endif // PERFECT_HASH_DYNAMIC_MPH_H
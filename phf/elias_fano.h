@@ -0,0 +1,122 @@
+#ifndef PERFECT_HASH_ELIAS_FANO_H
+#define PERFECT_HASH_ELIAS_FANO_H
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "bits.h"
+#include "serialize.h"
+
+namespace phf {
+
+//
+// A compressed non-decreasing sequence of integers in the Elias-Fano
+// representation. The low bits of each value are stored in a packed
+// array and the high bits are stored in the unary code. Random access
+// is supported with the help of sampled positions of each n-th value.
+//
+class elias_fano
+{
+public:
+	static constexpr std::uint64_t tag = UINT64_C(0x314f4e4146534c45);
+
+	// The sampling step of the select index.
+	static constexpr std::size_t select_step = 256;
+
+	elias_fano()
+	{
+	}
+
+	explicit elias_fano(const std::vector<std::uint64_t> &values) : size_(values.size())
+	{
+		if (size_ == 0)
+			return;
+
+		std::uint64_t universe = values.back() + 1;
+		if (universe > size_)
+			low_nbits_ = bits::width(universe / size_) - 1;
+
+		low_.resize(bits::nwords(size_ * low_nbits_));
+		high_.resize(bits::nwords(size_ + (values.back() >> low_nbits_) + 1));
+		for (std::size_t i = 0; i < size_; i++) {
+			auto value = values[i];
+			if (i && value < values[i - 1])
+				throw std::invalid_argument("the sequence must be non-decreasing");
+
+			bits::put(low_, i * low_nbits_, low_nbits_, value);
+			std::size_t position = (value >> low_nbits_) + i;
+			high_[position / 64] |= UINT64_C(1) << (position % 64);
+			if (i % select_step == 0)
+				select_.push_back(position);
+		}
+	}
+
+	std::size_t size() const
+	{
+		return size_;
+	}
+
+	std::size_t memory_size() const
+	{
+		return (low_.size() + high_.size() + select_.size()) * sizeof(std::uint64_t);
+	}
+
+	std::uint64_t operator[](std::size_t index) const
+	{
+		std::uint64_t high = select(index) - index;
+		return (high << low_nbits_) | bits::get(low_, index * low_nbits_, low_nbits_);
+	}
+
+	void write(std::ostream &os) const
+	{
+		io::write_tag(os, tag);
+		io::write(os, std::uint64_t{size_});
+		io::write(os, low_nbits_);
+		io::write(os, low_);
+		io::write(os, high_);
+		io::write(os, select_);
+	}
+
+	void read(std::istream &is)
+	{
+		std::uint64_t size;
+		io::read_tag(is, tag);
+		io::read(is, size);
+		io::read(is, low_nbits_);
+		io::read(is, low_);
+		io::read(is, high_);
+		io::read(is, select_);
+		size_ = size;
+	}
+
+private:
+	// Find the position of the given set bit in the high bits array.
+	std::size_t select(std::size_t index) const
+	{
+		std::size_t position = select_[index / select_step];
+		std::size_t rest = index % select_step;
+
+		std::size_t word_index = position / 64;
+		std::uint64_t word = high_[word_index] & ~bits::mask(position % 64);
+		for (;;) {
+			unsigned count = __builtin_popcountll(word);
+			if (rest < count)
+				return word_index * 64 + bits::select(word, rest);
+			rest -= count;
+			word = high_[++word_index];
+		}
+	}
+
+	std::size_t size_ = 0;
+	unsigned low_nbits_ = 0;
+
+	std::vector<std::uint64_t> low_;
+	std::vector<std::uint64_t> high_;
+	std::vector<std::uint64_t> select_;
+};
+
+} // namespace phf
+
+#endif // PERFECT_HASH_ELIAS_FANO_H
@@ -0,0 +1,119 @@
+#ifndef PERFECT_HASH_EMIT_H
+#define PERFECT_HASH_EMIT_H
+
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+namespace phf {
+
+//
+// Emit the C++ code for a hasher object named static_hasher that uses
+// the given seeds.
+//
+template <typename Seeds>
+void
+emit_static_hasher(std::ostream &os, std::size_t count, const std::string &key_type_name,
+		   const std::string &hasher_type_name, const Seeds &seeds)
+{
+	std::string emit_count = std::to_string(count);
+	os << "phf::hasher<" << emit_count << ", " << key_type_name << ", " << hasher_type_name
+	   << "> static_hasher(std::array<std::uint64_t, " << emit_count << "> {{\n\t0x"
+	   << std::hex;
+	for (std::size_t i = 0; i < count; i++) {
+		os << seeds[i];
+		if (i != (count - 1))
+			os << ", 0x";
+	}
+	os << std::dec << "\n}});\n\n";
+}
+
+//
+// Emit the C++ code for a statically initialized bitset along with a
+// minimal container type that provides access to it. The container is
+// named static_bitset and is suitable for the Bitset template argument
+// of the hash function objects.
+//
+template <typename Bitset>
+void
+emit_static_bitset(std::ostream &os, const Bitset &bitset)
+{
+	os << "static constexpr std::size_t static_bitset_size = " << bitset.size() << ";\n\n";
+	os << "std::array<std::uint64_t, static_bitset_size> static_bitset_data {{\n";
+	for (std::size_t i = 0; i < bitset.size(); i++)
+		os << "\t0x" << std::hex << bitset[i] << std::dec << ",\n";
+	os << "}};\n\n";
+	os << "struct static_bitset {\n";
+	os << "\tusing value_type = std::uint64_t;\n";
+	os << "\tusing iterator = std::uint64_t *;\n";
+	os << "\tusing const_iterator = const std::uint64_t *;\n";
+	os << "\tstd::size_t size() const { return static_bitset_data.size(); }\n";
+	os << "\tvalue_type& operator[](std::size_t i) { return static_bitset_data[i]; }\n";
+	os << "\tconst value_type& operator[](std::size_t i) const { return "
+	      "static_bitset_data[i]; }\n";
+	os << "};\n\n";
+}
+
+//
+// Emit C++ literals for keys and values of the common types.
+//
+
+template <typename T, std::enable_if_t<std::is_arithmetic<T>::value, int> = 0>
+void
+emit_literal(std::ostream &os, T value)
+{
+	if (std::is_same<T, bool>::value) {
+		os << (value ? "true" : "false");
+	} else if (std::is_floating_point<T>::value) {
+		auto precision = os.precision(std::numeric_limits<T>::max_digits10);
+		os << value;
+		os.precision(precision);
+	} else {
+		os << +value << (std::is_unsigned<T>::value ? "u" : "");
+	}
+}
+
+static inline void
+emit_literal(std::ostream &os, const char *data, std::size_t size)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	// Hex escapes are terminated by splitting the literal in case the
+	// next char is a hex digit.
+	os << '"';
+	for (std::size_t i = 0; i < size; i++) {
+		unsigned char c = data[i];
+		if (c == '"' || c == '\\')
+			os << '\\' << c;
+		else if (c >= 0x20 && c < 0x7f)
+			os << c;
+		else
+			os << "\\x" << hex[c >> 4] << hex[c & 15] << "\"\"";
+	}
+	os << '"';
+}
+
+template <typename T, typename A>
+void
+emit_literal(std::ostream &os, const std::basic_string<char, T, A> &value)
+{
+	emit_literal(os, value.data(), value.size());
+}
+
+//
+// The default key and value formatter for emit() methods.
+//
+struct emit_literal_fn
+{
+	template <typename T>
+	void operator()(std::ostream &os, const T &value) const
+	{
+		emit_literal(os, value);
+	}
+};
+
+} // namespace phf
+
+#endif // PERFECT_HASH_EMIT_H
@@ -0,0 +1,118 @@
+#ifndef PERFECT_HASH_FRAGMENTS_H
+#define PERFECT_HASH_FRAGMENTS_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/uio.h>
+
+namespace phf {
+
+//
+// A non-owning view of a key split across several buffers as it arrives
+// from the network, for instance a Host header that spans two segments.
+// A hasher that provides an overload for it must give the same result as
+// for the contiguous key. Then a function built for string keys might be
+// looked up with the fragments directly:
+//
+//   iovec iov[] = {{segment1, size1}, {segment2, size2}};
+//   auto rank = mph->find(phf::fragments(iov));
+//
+struct fragments
+{
+	const iovec *iov;
+	std::size_t count;
+
+	fragments(const iovec *iov, std::size_t count) : iov(iov), count(count)
+	{
+	}
+
+	template <std::size_t N>
+	fragments(const iovec (&iov)[N]) : iov(iov), count(N)
+	{
+	}
+
+	template <typename A>
+	fragments(const std::vector<iovec, A> &iov) : iov(iov.data()), count(iov.size())
+	{
+	}
+
+	// The total key size.
+	std::size_t size() const
+	{
+		std::size_t size = 0;
+		for (std::size_t i = 0; i < count; i++)
+			size += iov[i].iov_len;
+		return size;
+	}
+
+	// Call the given function for each non-empty fragment.
+	template <typename F>
+	void for_each(F f) const
+	{
+		for (std::size_t i = 0; i < count; i++) {
+			if (iov[i].iov_len != 0)
+				f(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+		}
+	}
+
+	// Call the given function for each 8-byte word of the key as if it
+	// was contiguous. The last word is padded with zeros.
+	template <typename F>
+	void for_each_word(F f) const
+	{
+		char buffer[8];
+		std::size_t nbuffered = 0;
+		for_each([&](const char *data, std::size_t size) {
+			if (nbuffered != 0) {
+				std::size_t n = size < 8 - nbuffered ? size : 8 - nbuffered;
+				std::memcpy(buffer + nbuffered, data, n);
+				nbuffered += n;
+				data += n;
+				size -= n;
+				if (nbuffered < 8)
+					return;
+				std::uint64_t word;
+				std::memcpy(&word, buffer, 8);
+				f(word);
+				nbuffered = 0;
+			}
+			for (; size >= 8; size -= 8, data += 8) {
+				std::uint64_t word;
+				std::memcpy(&word, data, 8);
+				f(word);
+			}
+			std::memcpy(buffer, data, size);
+			nbuffered = size;
+		});
+		if (nbuffered != 0) {
+			std::uint64_t word = 0;
+			std::memcpy(&word, buffer, nbuffered);
+			f(word);
+		}
+	}
+
+	// The conversion is explicit so that a lookup does not copy the key
+	// unless it has to.
+	explicit operator std::string() const
+	{
+		std::string key;
+		key.reserve(size());
+		for_each([&key](const char *data, std::size_t size) { key.append(data, size); });
+		return key;
+	}
+};
+
+static inline std::ostream &
+operator<<(std::ostream &os, const fragments &key)
+{
+	key.for_each([&os](const char *data, std::size_t size) { os.write(data, size); });
+	return os;
+}
+
+} // namespace phf
+
+#endif // PERFECT_HASH_FRAGMENTS_H
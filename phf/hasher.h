@@ -6,13 +6,22 @@
 #include <bitset>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <utility>
 
+#include "bits.h"
 #include "detect.h"
 #include "rng.h"
 
 namespace phf {
 
+//
+// The rank value returned by the hash function objects for missing keys.
+// It is the largest std::size_t value so it does not clash with the bit
+// positions of a function that is not minimal even for multi-GB bitsets.
+//
+static constexpr std::size_t not_found = std::numeric_limits<std::size_t>::max();
+
 //
 // A hasher that produces multiple hash values based on a standard or
 // extended hasher.
@@ -60,6 +69,12 @@ public:
 	{
 	}
 
+	hasher &operator=(const hasher &other)
+	{
+		seeds_ = other.seeds_;
+		return *this;
+	}
+
 	void operator=(const key_type &key)
 	{
 		key_ = key;
@@ -70,6 +85,24 @@ public:
 		return hash(key_, seeds_[index]);
 	}
 
+	// Compute a hash value for the given key without remembering it.
+	result_type operator()(const key_type &key, std::size_t index) const
+	{
+		return hash(key, seeds_[index]);
+	}
+
+	// Compute a hash value for a key given in another form that the
+	// extended base hasher accepts, for instance a view of the key. It
+	// must hash the same as the key itself.
+	template <typename K, typename H = base_hasher,
+		  std::enable_if_t<!std::is_same<K, key_type>::value
+					   && hasher_detect<H, K, result_type>::is_extended,
+				   int> = 0>
+	result_type operator()(const K &key, std::size_t index) const
+	{
+		return base_hasher::operator()(key, seeds_[index]);
+	}
+
 	const seed_array_type &seeds() const
 	{
 		return seeds_;
@@ -78,17 +111,21 @@ public:
 private:
 	template <typename H = base_hasher, typename K = key_type, typename V = result_type,
 		  std::enable_if_t<hasher_detect<H, K, V>::is_extended, int> = 0>
-	result_type hash(const key_type &key, seed_type seed)
+	result_type hash(const key_type &key, seed_type seed) const
 	{
 		return base_hasher::operator()(key, seed);
 	}
 
 	template <typename H = base_hasher, typename K = key_type, typename V = result_type,
 		  std::enable_if_t<not hasher_detect<H, K, V>::is_extended, int> = 0>
-	result_type hash(const key_type &key, seed_type seed)
+	result_type hash(const key_type &key, seed_type seed) const
 	{
-		// TODO: Do something better.
-		return base_hasher::operator()(key) * seed;
+		// Mix the seed into the plain hash value. A plain multiplication
+		// would keep the low bits of the keys that collide on the first
+		// level the same on all the others. The mix is a bijection so the
+		// keys with distinct plain hash values stay distinct, but this
+		// cannot tell apart those with the same value.
+		return bits::mix(base_hasher::operator()(key) ^ seed);
 	}
 
 	// The current key to hash.
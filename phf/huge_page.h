@@ -0,0 +1,407 @@
+#ifndef PERFECT_HASH_HUGE_PAGE_H
+#define PERFECT_HASH_HUGE_PAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+
+// Older headers might lack the explicit huge page size flags.
+#if defined(MAP_HUGETLB) && !defined(MAP_HUGE_SHIFT)
+#define MAP_HUGE_SHIFT 26
+#endif
+#if defined(MAP_HUGETLB) && !defined(MAP_HUGE_2MB)
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#if defined(MAP_HUGETLB) && !defined(MAP_HUGE_1GB)
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+namespace phf {
+
+//
+// The kind of memory pages that back a table.
+//
+// The transparent kind means that the memory is marked as eligible for
+// transparent huge pages. The kernel then uses huge pages where it can
+// but might still use normal ones for some parts of it.
+//
+enum class page_kind
+{
+	normal,
+	transparent,
+	huge_2mb,
+	huge_1gb,
+};
+
+static inline const char *
+page_kind_name(page_kind kind)
+{
+	switch (kind) {
+	case page_kind::normal:
+		return "normal";
+	case page_kind::transparent:
+		return "transparent";
+	case page_kind::huge_2mb:
+		return "2MB";
+	case page_kind::huge_1gb:
+		return "1GB";
+	}
+	return "unknown";
+}
+
+namespace huge_page {
+
+static constexpr std::size_t size_2mb = std::size_t(1) << 21;
+static constexpr std::size_t size_1gb = std::size_t(1) << 30;
+
+// The smaller blocks take normal pages as a huge one would be mostly
+// wasted for them. They are still page aligned so the layout of
+// paged_mph holds for them too.
+static constexpr std::size_t min_size = size_2mb;
+static constexpr std::size_t small_alignment = 4096;
+
+// A mapped block. The blocks are kept in a table keyed by their address
+// rather than in a header in front of the data, so a block takes whole
+// huge pages and no more.
+struct block
+{
+	std::size_t length;
+	page_kind kind;
+};
+
+struct block_table
+{
+	std::mutex mutex;
+	std::unordered_map<const void *, block> blocks;
+};
+
+// The table is shared by all the translation units and never destroyed
+// so the blocks might be freed at any time during the program exit.
+inline block_table &
+blocks()
+{
+	static auto *table = new block_table;
+	return *table;
+}
+
+static inline std::size_t
+round_up(std::size_t size, std::size_t page_size)
+{
+	return (size + page_size - 1) & ~(page_size - 1);
+}
+
+//
+// Map an anonymous block of memory. The explicit huge pages are tried
+// first. They need a reserved pool (vm.nr_hugepages) so if the pool is
+// empty then normal pages marked for transparent huge pages are used.
+//
+static inline void *
+map(std::size_t size)
+{
+	void *base = MAP_FAILED;
+	std::size_t length = 0;
+	page_kind kind = page_kind::normal;
+
+#ifdef MAP_HUGETLB
+	if (size >= size_1gb) {
+		length = round_up(size, size_1gb);
+		base = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_1GB, -1, 0);
+		kind = page_kind::huge_1gb;
+	}
+	if (base == MAP_FAILED) {
+		length = round_up(size, size_2mb);
+		base = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+		kind = page_kind::huge_2mb;
+	}
+#endif
+	if (base == MAP_FAILED) {
+		length = round_up(size, size_2mb);
+		base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+			    -1, 0);
+		if (base == MAP_FAILED)
+			throw std::bad_alloc();
+		kind = page_kind::normal;
+#ifdef MADV_HUGEPAGE
+		if (madvise(base, length, MADV_HUGEPAGE) == 0)
+			kind = page_kind::transparent;
+#endif
+	}
+
+	auto &table = blocks();
+	try {
+		std::lock_guard<std::mutex> lock(table.mutex);
+		table.blocks.emplace(base, block{length, kind});
+	} catch (...) {
+		munmap(base, length);
+		throw;
+	}
+	return base;
+}
+
+static inline void
+unmap(void *data)
+{
+	auto &table = blocks();
+	std::lock_guard<std::mutex> lock(table.mutex);
+	auto it = table.blocks.find(data);
+	if (it == table.blocks.end())
+		return;
+	munmap(data, it->second.length);
+	table.blocks.erase(it);
+}
+
+static inline page_kind
+kind(const void *data)
+{
+	auto &table = blocks();
+	std::lock_guard<std::mutex> lock(table.mutex);
+	auto it = table.blocks.find(data);
+	return it == table.blocks.end() ? page_kind::normal : it->second.kind;
+}
+
+} // namespace huge_page
+
+//
+// An allocator that backs large blocks with huge pages. This cuts the
+// TLB misses for lookups in large tables where nearly every access goes
+// to a different page. It is meant for the bitset and the rank directory
+// of a function:
+//
+//   phf::builder<16, Key, Hash, phf::huge_page_bitset> builder(...);
+//   ...
+//   auto kind = phf::page_kind_of(mph->bitset());
+//
+template <typename T>
+class huge_page_allocator
+{
+public:
+	using value_type = T;
+
+	huge_page_allocator() noexcept = default;
+
+	template <typename U>
+	huge_page_allocator(const huge_page_allocator<U> &) noexcept
+	{
+	}
+
+	T *allocate(std::size_t n)
+	{
+		std::size_t size = n * sizeof(T);
+		if (size < huge_page::min_size) {
+			void *p;
+			if (posix_memalign(&p, huge_page::small_alignment, size) != 0)
+				throw std::bad_alloc();
+			return static_cast<T *>(p);
+		}
+		return static_cast<T *>(huge_page::map(size));
+	}
+
+	void deallocate(T *p, std::size_t n) noexcept
+	{
+		if (n * sizeof(T) < huge_page::min_size)
+			std::free(p);
+		else
+			huge_page::unmap(p);
+	}
+
+	// Get the kind of pages for a block allocated by this allocator.
+	static page_kind kind(const T *p, std::size_t n)
+	{
+		if (p == nullptr || n * sizeof(T) < huge_page::min_size)
+			return page_kind::normal;
+		return huge_page::kind(p);
+	}
+};
+
+template <typename T, typename U>
+bool
+operator==(const huge_page_allocator<T> &, const huge_page_allocator<U> &)
+{
+	return true;
+}
+
+template <typename T, typename U>
+bool
+operator!=(const huge_page_allocator<T> &, const huge_page_allocator<U> &)
+{
+	return false;
+}
+
+using huge_page_bitset = std::vector<std::uint64_t, huge_page_allocator<std::uint64_t>>;
+
+template <typename T>
+page_kind
+page_kind_of(const std::vector<T, huge_page_allocator<T>> &vector)
+{
+	return huge_page_allocator<T>::kind(vector.data(), vector.capacity());
+}
+
+//
+// A read-only array of 64-bit words mapped from a file. It might serve as
+// the bitset of a function that is stored in a file by itself so that it
+// is loaded without copying.
+//
+// A file on a hugetlbfs mount is mapped with its huge pages. For other
+// files transparent huge pages are requested. These are only used for
+// the page cache if the kernel supports it for the file system.
+//
+class mapped_words
+{
+public:
+	using value_type = std::uint64_t;
+	using iterator = const value_type *;
+	using const_iterator = const value_type *;
+
+	mapped_words() = default;
+
+	// Map the given number of words at the given byte offset or the rest
+	// of the file if the number is zero.
+	explicit mapped_words(const std::string &path, std::size_t offset = 0,
+			      std::size_t size = 0)
+	{
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			throw std::runtime_error("failed to open " + path);
+
+		struct stat st;
+		if (fstat(fd, &st) < 0) {
+			close(fd);
+			throw std::runtime_error("failed to stat " + path);
+		}
+		std::size_t file_size = st.st_size;
+		if (size == 0 && offset <= file_size)
+			size = (file_size - offset) / sizeof(value_type);
+		if (offset + size * sizeof(value_type) > file_size) {
+			close(fd);
+			throw std::invalid_argument("mapped range exceeds the file size");
+		}
+		if (size == 0) {
+			close(fd);
+			return;
+		}
+
+		// The mapping offset must be page aligned. On hugetlbfs this is
+		// the huge page size reported as the block size.
+		std::size_t page_size = sysconf(_SC_PAGESIZE);
+		page_kind kind = page_kind::normal;
+#ifdef __linux__
+		static constexpr long hugetlbfs_magic = 0x958458f6;
+		struct statfs sfs;
+		if (fstatfs(fd, &sfs) == 0 && sfs.f_type == hugetlbfs_magic) {
+			page_size = st.st_blksize;
+			kind = page_size >= huge_page::size_1gb ? page_kind::huge_1gb
+								: page_kind::huge_2mb;
+		}
+#endif
+		std::size_t base_offset = offset & ~(page_size - 1);
+		length_ = huge_page::round_up(offset - base_offset + size * sizeof(value_type),
+					      page_size);
+		base_ = mmap(nullptr, length_, PROT_READ, MAP_SHARED, fd, base_offset);
+		close(fd);
+		if (base_ == MAP_FAILED) {
+			base_ = nullptr;
+			throw std::runtime_error("failed to map " + path);
+		}
+#ifdef MADV_HUGEPAGE
+		if (kind == page_kind::normal && madvise(base_, length_, MADV_HUGEPAGE) == 0)
+			kind = page_kind::transparent;
+#endif
+
+		data_ = reinterpret_cast<const value_type *>(static_cast<const char *>(base_)
+							     + (offset - base_offset));
+		size_ = size;
+		kind_ = kind;
+	}
+
+	~mapped_words()
+	{
+		if (base_ != nullptr)
+			munmap(base_, length_);
+	}
+
+	mapped_words(mapped_words &&other) noexcept
+		: base_(other.base_), length_(other.length_), data_(other.data_),
+		  size_(other.size_), kind_(other.kind_)
+	{
+		other.base_ = nullptr;
+		other.data_ = nullptr;
+		other.size_ = 0;
+	}
+
+	mapped_words &operator=(mapped_words &&other) noexcept
+	{
+		std::swap(base_, other.base_);
+		std::swap(length_, other.length_);
+		std::swap(data_, other.data_);
+		std::swap(size_, other.size_);
+		std::swap(kind_, other.kind_);
+		return *this;
+	}
+
+	mapped_words(const mapped_words &) = delete;
+	mapped_words &operator=(const mapped_words &) = delete;
+
+	std::size_t size() const
+	{
+		return size_;
+	}
+
+	const value_type &operator[](std::size_t index) const
+	{
+		return data_[index];
+	}
+
+	const value_type *data() const
+	{
+		return data_;
+	}
+
+	const_iterator begin() const
+	{
+		return data_;
+	}
+
+	const_iterator end() const
+	{
+		return data_ + size_;
+	}
+
+	page_kind kind() const
+	{
+		return kind_;
+	}
+
+private:
+	void *base_ = nullptr;
+	std::size_t length_ = 0;
+	const value_type *data_ = nullptr;
+	std::size_t size_ = 0;
+	page_kind kind_ = page_kind::normal;
+};
+
+static inline page_kind
+page_kind_of(const mapped_words &words)
+{
+	return words.kind();
+}
+
+} // namespace phf
+
+#endif // PERFECT_HASH_HUGE_PAGE_H
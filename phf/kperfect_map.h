@@ -0,0 +1,419 @@
+#ifndef PERFECT_HASH_KPERFECT_MAP_H
+#define PERFECT_HASH_KPERFECT_MAP_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "bits.h"
+#include "hasher.h"
+#include "paged.h"
+#include "rng.h"
+#include "serialize.h"
+
+namespace phf {
+
+//
+// A value slot of a k-perfect map line with or without the key.
+//
+template <typename Key, typename Value, bool store_key>
+struct kperfect_slot
+{
+	Key key;
+	Value value;
+
+	bool matches(const Key &other) const
+	{
+		return key == other;
+	}
+};
+
+template <typename Key, typename Value>
+struct kperfect_slot<Key, Value, false>
+{
+	Value value;
+
+	bool matches(const Key &) const
+	{
+		return true;
+	}
+};
+
+//
+// A static key to value map based on a k-perfect hash function that maps
+// each key to a bucket of at most k keys. A bucket is a 64-byte line with
+// an 8-bit tag for each slot followed by the slots themselves. A lookup
+// compares the tags of the line with the key tag at once and takes the
+// value from the matching slot. So it needs a single cache line with no
+// rank computation and no separate value array.
+//
+// The function has several levels of buckets. The keys of an overfull
+// bucket and those whose tags collide there go to the next level and
+// the bucket is marked as overflowed. The tags of the keys that stay in
+// a bucket differ from the tags of all the keys that move on. So a tag
+// match always finds the right slot for a member key, and a mismatch in
+// a bucket that is not overflowed rejects a non-member key.
+//
+// If the keys are not stored then a non-member key is rejected with the
+// probability of about 1 - k/255. Otherwise the keys are stored in the
+// slots along with the values. The slot contents are copied as is so they
+// need to be trivially copyable. The number of slots k is as many as fit
+// 48 bytes, up to 15, for instance 6 for 64-bit values.
+//
+template <typename Key, typename Value, typename Hash = std::hash<Key>, bool store_keys = false>
+class kperfect_map
+{
+public:
+	using key_type = Key;
+	using mapped_type = Value;
+	using hasher_type = hasher<8, key_type, Hash>;
+	using slot_type = kperfect_slot<key_type, mapped_type, store_keys>;
+
+	static constexpr std::size_t count = hasher_type::count;
+
+	static constexpr std::size_t line_size = 64;
+	static constexpr std::size_t tags_size = 16;
+	// The last tag byte is the overflow flag.
+	static constexpr std::size_t overflow_index = tags_size - 1;
+	static constexpr std::size_t max_nslots = (line_size - tags_size) / sizeof(slot_type);
+	static constexpr std::size_t nslots = max_nslots < overflow_index ? max_nslots
+									  : overflow_index;
+	static_assert(nslots != 0, "the slot type is too large for a line");
+	static_assert(std::is_trivially_copyable<slot_type>::value,
+		      "the slot type must be trivially copyable");
+
+	struct alignas(line_size) line
+	{
+		std::uint8_t tags[tags_size];
+		slot_type slots[nslots];
+	};
+	static_assert(sizeof(line) == line_size, "invalid line layout");
+
+	using line_array_type = std::vector<line, page_allocator<line>>;
+
+	// The serialized object tag: "KPERFMP1".
+	static constexpr std::uint64_t tag = UINT64_C(0x31504d465245504b);
+
+	kperfect_map(const hasher_type &hasher, std::array<std::size_t, count> levels,
+		     line_array_type &&lines)
+		: hasher_(hasher), levels_(levels), offsets_{{0}}, size_(0), lines_(std::move(lines))
+	{
+		std::size_t offset = 0;
+		for (std::size_t i = 0; i < count; i++) {
+			offsets_[i] = offset;
+			offset += levels_[i];
+		}
+		if (levels_[0] == 0 || offset != lines_.size())
+			throw std::invalid_argument("line array size mismatch");
+
+		for (const auto &l : lines_) {
+			for (std::size_t i = 0; i < nslots; i++)
+				size_ += l.tags[i] != 0;
+		}
+	}
+
+	std::size_t size() const
+	{
+		return size_;
+	}
+
+	std::size_t memory_size() const
+	{
+		return lines_.size() * sizeof(line);
+	}
+
+	const std::array<std::size_t, count> &levels() const
+	{
+		return levels_;
+	}
+
+	const line_array_type &lines() const
+	{
+		return lines_;
+	}
+
+	// Get the tag of a key from its level 0 hash value. The zero tag marks
+	// an empty slot. The low bits are used as the high ones select the
+	// bucket.
+	static std::uint8_t make_tag(std::uint64_t hash)
+	{
+		return 1 + bits::reduce32(hash, 255);
+	}
+
+	// Get the mask of the slots with the given tag.
+	static unsigned match(const line &l, std::uint8_t tag)
+	{
+#ifdef __SSE2__
+		auto tags = _mm_load_si128(reinterpret_cast<const __m128i *>(l.tags));
+		auto mask = _mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(tag)));
+		return mask & ((1u << nslots) - 1);
+#else
+		unsigned mask = 0;
+		for (std::size_t i = 0; i < nslots; i++)
+			mask |= unsigned(l.tags[i] == tag) << i;
+		return mask;
+#endif
+	}
+
+	// Find the global slot index of the key, that is the line index times
+	// the number of slots plus the slot index in the line.
+	std::size_t slot(const key_type &key) const
+	{
+		auto hash = hasher_(key, 0);
+		auto tag = make_tag(hash);
+		for (std::size_t level = 0; level < count; level++) {
+			if (level != 0)
+				hash = hasher_(key, level);
+			auto index = offsets_[level] + bits::reduce64(hash, levels_[level]);
+			const auto &l = lines_[index];
+			auto mask = match(l, tag);
+			if (mask != 0) {
+				auto i = __builtin_ctz(mask);
+				return l.slots[i].matches(key) ? index * nslots + i : not_found;
+			}
+			if (l.tags[overflow_index] == 0)
+				break;
+		}
+		return not_found;
+	}
+
+	const mapped_type *find(const key_type &key) const
+	{
+		auto index = slot(key);
+		if (index == not_found)
+			return nullptr;
+		return &lines_[index / nslots].slots[index % nslots].value;
+	}
+
+	bool contains(const key_type &key) const
+	{
+		return find(key) != nullptr;
+	}
+
+	const mapped_type &at(const key_type &key) const
+	{
+		auto value = find(key);
+		if (value == nullptr)
+			throw std::out_of_range("key not found");
+		return *value;
+	}
+
+	void write(std::ostream &os) const
+	{
+		io::write_tag(os, tag);
+		io::write(os, hasher_.seeds());
+		io::write(os, levels_);
+		io::write(os, lines_);
+	}
+
+	static std::unique_ptr<kperfect_map> read(std::istream &is)
+	{
+		typename hasher_type::seed_array_type seeds;
+		std::array<std::size_t, count> levels;
+		line_array_type lines;
+		io::read_tag(is, tag);
+		io::read(is, seeds);
+		io::read(is, levels);
+		io::read(is, lines);
+		return std::make_unique<kperfect_map>(hasher_type(seeds), levels, std::move(lines));
+	}
+
+private:
+	hasher_type hasher_;
+	std::array<std::size_t, count> levels_;
+	std::array<std::size_t, count> offsets_;
+	std::size_t size_;
+	line_array_type lines_;
+};
+
+//
+// A builder for the k-perfect maps.
+//
+template <typename Key, typename Value, typename Hash = std::hash<Key>, bool store_keys = false>
+class kperfect_map_builder
+{
+public:
+	using key_type = Key;
+	using mapped_type = Value;
+	using map_type = kperfect_map<key_type, mapped_type, Hash, store_keys>;
+	using hasher_type = typename map_type::hasher_type;
+
+	static constexpr std::size_t count = map_type::count;
+	static constexpr std::size_t nslots = map_type::nslots;
+
+	// Give up the build after this many attempts with different seeds.
+	static constexpr std::size_t max_attempts = 16;
+
+	// The load parameter sets the average number of keys per bucket on
+	// each level as a fraction of the bucket capacity.
+	kperfect_map_builder(double load, std::uint64_t seed) : load_(load), seed_(seed)
+	{
+		if (!(load_ > 0 && load_ <= 1))
+			throw std::invalid_argument("load must be in the (0, 1] range");
+	}
+
+	// Insert a key value pair. The value of a repeated key replaces
+	// the previous one.
+	void insert(const key_type &key, const mapped_type &value)
+	{
+		auto result = entries_.emplace(key, value);
+		if (!result.second)
+			result.first->second = value;
+	}
+
+	std::unique_ptr<map_type> build()
+	{
+		rng::rng128 rng(seed_);
+		for (std::size_t attempt = 0; attempt < max_attempts; attempt++) {
+			auto result = try_build(hasher_type(rng()));
+			if (result)
+				return result;
+#if PHF_DEBUG > 0
+			std::cerr << "kperfect_map: retry with a new seed\n";
+#endif
+		}
+		throw std::runtime_error("failed to place the key set");
+	}
+
+	void clear()
+	{
+		entries_.clear();
+	}
+
+private:
+	using entry_map = std::unordered_map<key_type, mapped_type>;
+	using entry_type = typename entry_map::value_type;
+	using line = typename map_type::line;
+
+	// The keys of a bucket are ordered by their level hash values rather
+	// than by their tags. Otherwise the keys with the larger tags would
+	// be left over and crowd the next levels with tag collisions.
+	struct item
+	{
+		std::uint64_t hash;
+		std::size_t bucket;
+		std::uint8_t tag;
+		const entry_type *entry;
+
+		bool operator<(const item &other) const
+		{
+			if (bucket != other.bucket)
+				return bucket < other.bucket;
+			return hash < other.hash;
+		}
+	};
+
+	std::unique_ptr<map_type> try_build(const hasher_type &hasher)
+	{
+		std::vector<const entry_type *> remaining;
+		remaining.reserve(entries_.size());
+		for (const auto &entry : entries_)
+			remaining.push_back(&entry);
+
+		std::array<std::size_t, count> levels{{0}};
+		typename map_type::line_array_type lines;
+		std::vector<item> items;
+		std::vector<const entry_type *> next;
+		std::array<std::size_t, 256> tag_counts{{0}};
+		for (std::size_t level = 0; level < count; level++) {
+			if (remaining.empty() && level != 0)
+				break;
+
+			// The level 0 holds the most of the keys. The other levels are
+			// less loaded so that fewer keys are left over and the last one
+			// takes a bucket per key to place the rest.
+			double load = level == 0 ? load_ : load_ / 2;
+			std::size_t nbuckets = std::ceil(remaining.size() / (load * nslots));
+			if (level + 1 == count)
+				nbuckets = remaining.size();
+			nbuckets = std::max(nbuckets, std::size_t{1});
+			levels[level] = nbuckets;
+			std::size_t offset = lines.size();
+			lines.resize(offset + nbuckets, line{});
+
+			items.clear();
+			for (const auto *entry : remaining) {
+				auto hash = hasher(entry->first, level);
+				auto tag = map_type::make_tag(level == 0 ? hash : hasher(entry->first, 0));
+				items.push_back({hash, bits::reduce64(hash, nbuckets), tag, entry});
+			}
+			std::sort(items.begin(), items.end());
+
+			// Place the keys with the tags that are unique in the bucket
+			// while there are free slots.
+			next.clear();
+			for (std::size_t i = 0; i < items.size();) {
+				auto &l = lines[offset + items[i].bucket];
+				std::size_t end = i + 1;
+				while (end < items.size() && items[end].bucket == items[i].bucket)
+					end++;
+
+				for (std::size_t j = i; j < end; j++)
+					tag_counts[items[j].tag]++;
+
+				std::size_t nplaced = 0;
+				for (std::size_t j = i; j < end; j++) {
+					bool unique = tag_counts[items[j].tag] == 1;
+					if (unique && nplaced < nslots) {
+						l.tags[nplaced] = items[j].tag;
+						set_slot(l.slots[nplaced], *items[j].entry);
+						nplaced++;
+					} else {
+						next.push_back(items[j].entry);
+						l.tags[map_type::overflow_index] = 1;
+					}
+				}
+				for (std::size_t j = i; j < end; j++)
+					tag_counts[items[j].tag] = 0;
+				i = end;
+			}
+			remaining.swap(next);
+		}
+		if (!remaining.empty())
+			return nullptr;
+
+#if PHF_DEBUG > 0
+		std::cerr << "kperfect_map: " << entries_.size() << " keys, " << lines.size()
+			  << " lines, levels";
+		for (auto size : levels)
+			std::cerr << ' ' << size;
+		std::cerr << '\n';
+#endif
+
+		return std::make_unique<map_type>(hasher, levels, std::move(lines));
+	}
+
+	static void set_slot(kperfect_slot<key_type, mapped_type, true> &slot,
+			     const entry_type &entry)
+	{
+		slot.key = entry.first;
+		slot.value = entry.second;
+	}
+
+	static void set_slot(kperfect_slot<key_type, mapped_type, false> &slot,
+			     const entry_type &entry)
+	{
+		slot.value = entry.second;
+	}
+
+	const double load_;
+	const std::uint64_t seed_;
+
+	entry_map entries_;
+};
+
+} // namespace phf
+
+#endif // PERFECT_HASH_KPERFECT_MAP_H
@@ -0,0 +1,439 @@
+#ifndef PERFECT_HASH_MONOTONE_H
+#define PERFECT_HASH_MONOTONE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "bits.h"
+#include "emit.h"
+#include "hasher.h"
+#include "retrieval.h"
+#include "rng.h"
+#include "serialize.h"
+
+namespace phf {
+
+//
+// Key traits for the monotone hash functions. The keys are seen as bit
+// strings in a prefix-free encoding that keeps their order. For a given
+// key type the traits provide the length of the longest common prefix of
+// two distinct keys and a hash value for a prefix of a key.
+//
+template <typename Key, typename Enable = void>
+struct monotone_key_traits;
+
+//
+// Unsigned integers are encoded with all their bits from the highest one.
+//
+template <typename Key>
+struct monotone_key_traits<Key, std::enable_if_t<std::is_unsigned<Key>::value>>
+{
+	static constexpr std::size_t key_nbits = 8 * sizeof(Key);
+
+	static std::size_t nbits(Key)
+	{
+		return key_nbits;
+	}
+
+	static std::size_t lcp(Key a, Key b)
+	{
+		std::uint64_t x = std::uint64_t{a} ^ std::uint64_t{b};
+		return x == 0 ? key_nbits : key_nbits - bits::width(x);
+	}
+
+	static std::uint64_t hash(Key key, std::uint64_t seed)
+	{
+		return prefix_hash(key, key_nbits, seed);
+	}
+
+	static std::uint64_t prefix_hash(Key key, std::size_t nbits, std::uint64_t seed)
+	{
+		std::uint64_t prefix = nbits == 0 ? 0 : std::uint64_t{key} >> (key_nbits - nbits);
+		return bits::mix(bits::mix(seed ^ nbits) ^ prefix);
+	}
+};
+
+//
+// Strings are encoded with 9 bits per character: a set bit followed by
+// the 8 character bits. The encoding ends with a clear bit. So a string
+// comes before its extensions and the order is the same as with the
+// std::string comparison.
+//
+template <>
+struct monotone_key_traits<std::string>
+{
+	static std::size_t nbits(const std::string &key)
+	{
+		return key.size() * 9 + 1;
+	}
+
+	static std::size_t lcp(const std::string &a, const std::string &b)
+	{
+		auto n = std::min(a.size(), b.size());
+		auto d = std::mismatch(a.begin(), a.begin() + n, b.begin());
+		std::size_t i = d.first - a.begin();
+		if (i == n)
+			return a.size() == b.size() ? nbits(a) : i * 9;
+		unsigned x = static_cast<unsigned char>(a[i]) ^ static_cast<unsigned char>(b[i]);
+		return i * 9 + 1 + (8 - bits::width(x));
+	}
+
+	static std::uint64_t hash(const std::string &key, std::uint64_t seed)
+	{
+		return prefix_hash(key, nbits(key), seed);
+	}
+
+	static std::uint64_t prefix_hash(const std::string &key, std::size_t nbits,
+					 std::uint64_t seed)
+	{
+		// A length beyond the key might come for a non-member key.
+		if (nbits > monotone_key_traits::nbits(key))
+			return bits::mix(seed ^ nbits);
+
+		// The whole characters and the leading bits of the next one.
+		std::size_t n = nbits / 9;
+		unsigned r = nbits % 9;
+		std::uint64_t tail = 0;
+		if (r != 0 && n < key.size())
+			tail = (0x100 | static_cast<unsigned char>(key[n])) >> (9 - r);
+
+		std::uint64_t h = bits::mix(seed ^ nbits);
+		std::size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			std::uint64_t word;
+			std::memcpy(&word, key.data() + i, 8);
+			h = bits::mix(h ^ word);
+		}
+		std::uint64_t word = 0;
+		std::memcpy(&word, key.data() + i, n - i);
+		return bits::mix(h ^ word ^ (tail << 56));
+	}
+};
+
+//
+// A monotone minimal perfect hash function object. It maps the keys of
+// a sorted set to their positions in the set. It is based on bucketing
+// with relative ranking as described in this paper:
+//
+// * Djamal Belazzougui, Paolo Boldi, Rasmus Pagh, Sebastiano Vigna.
+// Monotone Minimal Perfect Hashing: Searching a Sorted Table with O(1)
+// Accesses.
+//
+// The sorted keys are split into buckets of 2^bucket_bits keys. The keys
+// of a bucket share a prefix that is the longest common prefix of the
+// first and the last key of the bucket. These prefixes are distinct for
+// distinct buckets. One retrieval structure maps each key to its offset
+// within the bucket and to the length of the bucket prefix. The length
+// is stored as an index into a small table of distinct prefix lengths.
+// Another retrieval structure maps the bucket prefixes to the bucket
+// numbers. So a lookup takes two retrieval lookups and the keys are not
+// stored. All the structures are packed into a single bitset.
+//
+// The result for a key not from the original set is arbitrary.
+//
+template <typename Key, typename Traits = monotone_key_traits<Key>,
+	  typename Rank = std::size_t, typename Bitset = std::vector<std::uint64_t>>
+class monotone_hash
+{
+public:
+	using key_type = Key;
+	using traits_type = Traits;
+	using rank_type = Rank;
+	using bitset_type = Bitset;
+
+	using bitset_value_type = typename bitset_type::value_type;
+	static_assert(sizeof(bitset_value_type) == 8, "invalid value type");
+
+	// The serialized object tag: "MONOMPH1".
+	static constexpr std::uint64_t tag = UINT64_C(0x3148504d4f4e4f4d);
+
+	static constexpr unsigned max_bucket_bits = 16;
+	static constexpr unsigned length_nbits = 32;
+
+	monotone_hash(std::uint64_t seed, rank_type size, unsigned bucket_bits,
+		      rank_type nlengths, bitset_type &&bitset)
+		: seed_(seed), size_(size), bucket_bits_(bucket_bits), nlengths_(nlengths),
+		  bitset_(std::move(bitset))
+	{
+		if (bucket_bits_ < 1 || bucket_bits_ > max_bucket_bits)
+			throw std::invalid_argument("invalid bucket size");
+		if (nlengths_ == 0)
+			throw std::invalid_argument("prefix length table must not be empty");
+
+		rank_type nbuckets = (size_ + (rank_type{1} << bucket_bits_) - 1) >> bucket_bits_;
+		keys_ = fuse_layout(size_, bucket_bits_ + index_nbits(nlengths_));
+		buckets_ = fuse_layout(nbuckets, std::max(index_nbits(nbuckets), 1u));
+		buckets_offset_ = keys_.nbits();
+		lengths_offset_ = buckets_offset_ + buckets_.nbits();
+
+		std::size_t total_nbits = lengths_offset_ + nlengths_ * length_nbits;
+		if (bitset_.size() != bits::nwords(total_nbits))
+			throw std::invalid_argument("bitset size mismatch");
+	}
+
+	// The number of bits for an index in the range of the given size.
+	static unsigned index_nbits(std::size_t size)
+	{
+		return size > 1 ? bits::width(size - 1) : 0;
+	}
+
+	rank_type size() const
+	{
+		return size_;
+	}
+
+	unsigned bucket_bits() const
+	{
+		return bucket_bits_;
+	}
+
+	std::size_t memory_size() const
+	{
+		return bitset_.size() * sizeof(bitset_value_type);
+	}
+
+	const bitset_type &bitset() const
+	{
+		return bitset_;
+	}
+
+	std::size_t operator[](const key_type &key) const
+	{
+		auto value = keys_.lookup(bitset_, 0, traits_type::hash(key, seed_));
+		auto offset = value & bits::mask(bucket_bits_);
+		auto index = value >> bucket_bits_;
+		if (index >= nlengths_)
+			return not_found;
+
+		auto length = bits::get(bitset_, lengths_offset_ + index * length_nbits,
+					length_nbits);
+		auto hash = traits_type::prefix_hash(key, length, seed_);
+		auto bucket = buckets_.lookup(bitset_, buckets_offset_, hash);
+		auto rank = (bucket << bucket_bits_) + offset;
+		return rank < size_ ? rank : not_found;
+	}
+
+	//
+	// Emit the C++ code for a statically initialized function object
+	// named instance.
+	//
+	void emit(std::ostream &os, const std::string &name, const std::string &key_type_name,
+		  const std::string &traits_type_name = std::string()) const
+	{
+		std::string emit_class = "phf::monotone_hash<" + key_type_name + ", ";
+		if (traits_type_name.empty())
+			emit_class += "phf::monotone_key_traits<" + key_type_name + ">";
+		else
+			emit_class += traits_type_name;
+		emit_class += ", std::size_t, static_bitset>";
+
+		os << "namespace " << name << " {\n\n";
+		emit_static_bitset(os, bitset_);
+		os << "struct mph : " << emit_class << " {\n";
+		os << "\tmph() : " << emit_class << "(0x" << std::hex << seed_ << std::dec << ", "
+		   << size_ << ", " << bucket_bits_ << ", " << nlengths_ << ", static_bitset())"
+		   << " {\n";
+		os << "\t}\n";
+		os << "} instance;\n\n";
+		os << "} // namespace " << name << "\n\n";
+	}
+
+	void write(std::ostream &os) const
+	{
+		io::write_tag(os, tag);
+		io::write(os, seed_);
+		io::write(os, std::uint64_t{size_});
+		io::write(os, bucket_bits_);
+		io::write(os, std::uint64_t{nlengths_});
+		io::write(os, bitset_);
+	}
+
+	static std::unique_ptr<monotone_hash> read(std::istream &is)
+	{
+		std::uint64_t seed, size, nlengths;
+		unsigned bucket_bits;
+		bitset_type bitset;
+		io::read_tag(is, tag);
+		io::read(is, seed);
+		io::read(is, size);
+		io::read(is, bucket_bits);
+		io::read(is, nlengths);
+		io::read(is, bitset);
+		return std::make_unique<monotone_hash>(seed, size, bucket_bits, nlengths,
+						       std::move(bitset));
+	}
+
+private:
+	std::uint64_t seed_;
+	rank_type size_;
+	unsigned bucket_bits_;
+	rank_type nlengths_;
+
+	// The key to offset and prefix length index structure, the bucket
+	// prefix to bucket number structure and the prefix length table.
+	fuse_layout keys_;
+	fuse_layout buckets_;
+	std::size_t buckets_offset_;
+	std::size_t lengths_offset_;
+
+	bitset_type bitset_;
+};
+
+//
+// A builder for the monotone hash functions. The keys must be inserted
+// in the increasing order.
+//
+template <typename Key, typename Traits = monotone_key_traits<Key>>
+class monotone_builder
+{
+public:
+	using key_type = Key;
+	using traits_type = Traits;
+	using mph_type = monotone_hash<key_type, traits_type>;
+
+	// Give up the build after this many attempts with different seeds.
+	static constexpr std::size_t max_attempts = 16;
+
+	// With zero bucket bits the bucket size is chosen to minimize the
+	// function size.
+	monotone_builder(std::uint64_t seed, unsigned bucket_bits = 0)
+		: seed_(seed), bucket_bits_(bucket_bits)
+	{
+		if (bucket_bits_ > mph_type::max_bucket_bits)
+			throw std::invalid_argument("invalid bucket size");
+	}
+
+	void insert(const key_type &key)
+	{
+		if (!keys_.empty() && !(keys_.back() < key))
+			throw std::invalid_argument("keys must be inserted in the increasing order");
+		keys_.push_back(key);
+	}
+
+	std::unique_ptr<mph_type> build()
+	{
+		unsigned bucket_bits = bucket_bits_;
+		if (bucket_bits == 0) {
+			double best_nbits = 0;
+			for (unsigned b = 1; b <= max_auto_bucket_bits; b++) {
+				auto nbits = estimate_nbits(b);
+				if (bucket_bits == 0 || nbits < best_nbits) {
+					bucket_bits = b;
+					best_nbits = nbits;
+				}
+			}
+		}
+
+		// Find the bucket prefix lengths and the table of distinct ones.
+		auto lengths = prefix_lengths(bucket_bits);
+		std::vector<std::size_t> table(lengths);
+		std::sort(table.begin(), table.end());
+		table.erase(std::unique(table.begin(), table.end()), table.end());
+		if (table.empty())
+			table.push_back(0);
+
+		rng::rng128 rng(seed_);
+		std::uint64_t seed = seed_;
+		for (std::size_t attempt = 0; attempt < max_attempts; attempt++) {
+			auto result = try_build(seed, bucket_bits, lengths, table);
+			if (result)
+				return result;
+#if PHF_DEBUG > 0
+			std::cerr << "monotone_hash: retry with a new seed\n";
+#endif
+			seed = rng();
+		}
+		throw std::runtime_error("failed to build the monotone hash function");
+	}
+
+	void clear()
+	{
+		keys_.clear();
+	}
+
+private:
+	static constexpr unsigned max_auto_bucket_bits = 10;
+
+	const std::uint64_t seed_;
+	const unsigned bucket_bits_;
+
+	std::vector<key_type> keys_;
+
+	// Get the longest common prefix length of each bucket.
+	std::vector<std::size_t> prefix_lengths(unsigned bucket_bits) const
+	{
+		std::size_t bucket_size = std::size_t{1} << bucket_bits;
+		std::vector<std::size_t> lengths;
+		for (std::size_t first = 0; first < keys_.size(); first += bucket_size) {
+			auto last = std::min(first + bucket_size, keys_.size()) - 1;
+			lengths.push_back(traits_type::lcp(keys_[first], keys_[last]));
+		}
+		return lengths;
+	}
+
+	// Estimate the function size in bits for the given bucket size.
+	double estimate_nbits(unsigned bucket_bits) const
+	{
+		auto lengths = prefix_lengths(bucket_bits);
+		std::size_t nbuckets = lengths.size();
+		std::sort(lengths.begin(), lengths.end());
+		std::size_t nlengths = std::unique(lengths.begin(), lengths.end()) - lengths.begin();
+		return 1.125
+		       * (keys_.size() * (bucket_bits + mph_type::index_nbits(nlengths))
+			  + nbuckets * std::max(mph_type::index_nbits(nbuckets), 1u));
+	}
+
+	std::unique_ptr<mph_type> try_build(std::uint64_t seed, unsigned bucket_bits,
+					    const std::vector<std::size_t> &lengths,
+					    const std::vector<std::size_t> &table)
+	{
+		std::size_t nbuckets = lengths.size();
+		std::vector<std::pair<std::uint64_t, std::uint64_t>> key_items;
+		std::vector<std::pair<std::uint64_t, std::uint64_t>> bucket_items;
+		key_items.reserve(keys_.size());
+		bucket_items.reserve(nbuckets);
+		for (std::size_t i = 0; i < keys_.size(); i++) {
+			auto bucket = i >> bucket_bits;
+			auto index = std::lower_bound(table.begin(), table.end(), lengths[bucket])
+				     - table.begin();
+			auto offset = i & bits::mask(bucket_bits);
+			key_items.emplace_back(traits_type::hash(keys_[i], seed),
+					       (index << bucket_bits) | offset);
+			if (offset == 0) {
+				auto hash = traits_type::prefix_hash(keys_[i], lengths[bucket], seed);
+				bucket_items.emplace_back(hash, bucket);
+			}
+		}
+
+		fuse_layout key_layout(keys_.size(), bucket_bits + mph_type::index_nbits(table.size()));
+		fuse_layout bucket_layout(nbuckets, std::max(mph_type::index_nbits(nbuckets), 1u));
+		std::size_t total_nbits = key_layout.nbits() + bucket_layout.nbits()
+					  + table.size() * mph_type::length_nbits;
+
+		std::vector<std::uint64_t> bitset(bits::nwords(total_nbits));
+		if (!key_layout.assign(key_items, bitset, 0))
+			return nullptr;
+		if (!bucket_layout.assign(bucket_items, bitset, key_layout.nbits()))
+			return nullptr;
+		std::size_t offset = key_layout.nbits() + bucket_layout.nbits();
+		for (auto length : table) {
+			bits::put(bitset, offset, mph_type::length_nbits, length);
+			offset += mph_type::length_nbits;
+		}
+
+		return std::make_unique<mph_type>(seed, keys_.size(), bucket_bits, table.size(),
+						  std::move(bitset));
+	}
+};
+
+} // namespace phf
+
+#endif // PERFECT_HASH_MONOTONE_H
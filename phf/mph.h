@@ -1,24 +1,69 @@
 #ifndef PERFECT_HASH_MINIMAL_PERFECT_H
 #define PERFECT_HASH_MINIMAL_PERFECT_H
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <iostream>
+#include <memory>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "bits.h"
+#include "bloom.h"
+#include "emit.h"
 #include "hasher.h"
+#include "serialize.h"
 
 namespace phf {
 
-static constexpr std::size_t not_found = (unsigned int) (-1);
+//
+// The storage type for auxiliary arrays such as the rank directory. If
+// the bitset type is a container with an allocator then the same kind of
+// allocator is used for them, otherwise a plain vector is used.
+//
+template <typename Bitset, typename T>
+struct bitset_storage
+{
+	template <typename B>
+	static std::vector<T, typename std::allocator_traits<
+				      typename B::allocator_type>::template rebind_alloc<T>>
+	test(int);
+
+	template <typename B>
+	static std::vector<T> test(...);
+
+	using type = decltype(test<Bitset>(0));
+};
 
 //
 // A minimal perfect hash function object.
 //
+// Optionally the bitset might be followed by an array of per-rank key
+// fingerprints. In this case the contains() and find() methods reject
+// a non-member key with the probability 1 - 2^-fingerprint_bits. The
+// keys themselves are never stored.
+//
+// A function updated for a changed key set might also have a remap table
+// that translates the bitset ranks to the external ones. It consists of
+// runs of consecutive ranks so it stays small for small changes.
+//
+// A Bloom filter prefilter keyed by the level 0 hash might be added to
+// reject most non-member keys that pass the conflict filter before the
+// other levels are probed. This makes negative lookups cheaper at the cost
+// of one more memory access for the keys beyond level 0.
+//
+// A function that is not minimal returns the bit positions of the keys
+// instead of their ranks. These are unique but spread over gamma times
+// the key set size or so. Then there is no rank directory, that is a
+// quarter of the level size, and a lookup skips the rank computation. The
+// slot_rank() method translates a position to the rank when needed. The
+// fingerprints and the rank remap table are not supported in this mode.
+//
 template <std::size_t N, typename Key, typename Hash = std::hash<Key>,
 	  typename Rank = std::size_t, typename Bitset = std::vector<std::uint64_t>,
-	  bool enable_extra_keys = true>
+	  bool enable_extra_keys = true, bool minimal = true>
 class minimal_perfect_hash
 {
 public:
@@ -37,11 +82,51 @@ public:
 	static constexpr rank_type block_nvalues = 4;
 	static constexpr rank_type block_nbits = value_nbits * block_nvalues;
 
+	static constexpr unsigned min_fingerprint_bits = 4;
+	static constexpr unsigned max_fingerprint_bits = 16;
+
+	// The serialized object tag: "MPHBBHS1".
+	static constexpr std::uint64_t tag = UINT64_C(0x315348424248504d);
+
+	// A run of bitset ranks starting with the given one that map to
+	// consecutive external ranks.
+	struct remap_entry
+	{
+		rank_type internal;
+		rank_type external;
+	};
+	using remap_type = std::vector<remap_entry>;
+
+	// A key in another form than key_type that the hasher accepts. The
+	// types that convert to key_type implicitly are not included so that
+	// they are converted once rather than for each level. With extra keys
+	// it has to be possible to convert it to key_type explicitly.
+	template <typename K>
+	struct is_key_view
+		: std::integral_constant<
+			  bool, !std::is_convertible<K, key_type>::value
+					&& (!enable_extra_keys
+					    || std::is_constructible<key_type, const K &>::value)
+					&& hasher_detect<base_hasher_type, K,
+							 typename hasher_type::result_type>::is_extended>
+	{
+	};
+
 	minimal_perfect_hash(const hasher_type &hasher, std::array<rank_type, count> levels,
-			     bitset_type &&bitset)
+			     bitset_type &&bitset, unsigned fingerprint_bits = 0,
+			     remap_type &&remap = remap_type())
 		: hasher_(hasher), levels_(levels), bitset_(std::move(bitset)), filter_(0),
-		  max_rank_(0)
+		  fingerprints_(0), fingerprint_bits_(fingerprint_bits), max_rank_(0),
+		  remap_(std::move(remap))
 	{
+		if (fingerprint_bits != 0 && (fingerprint_bits < min_fingerprint_bits
+					      || fingerprint_bits > max_fingerprint_bits))
+			throw std::invalid_argument("invalid fingerprint size");
+
+		if (!minimal && (fingerprint_bits != 0 || !remap_.empty()))
+			throw std::invalid_argument(
+				"fingerprints and rank remap need a minimal function");
+
 		rank_type rank_space = 0;
 		for (auto level : levels_) {
 			if (level != 0 && (level < value_nbits || (level & (level - 1)) != 0))
@@ -51,21 +136,40 @@ public:
 
 		// Check if there is a conflict filter.
 		rank_type total_space = bitset_.size() * value_nbits;
-		if (total_space != (rank_space + levels_[0]))
+		if (total_space < (rank_space + levels_[0])
+		    || (fingerprint_bits_ == 0 && total_space != (rank_space + levels_[0])))
 			throw std::invalid_argument(
 				"filter size must be equal to the level 0 size");
 		filter_ = rank_space / value_nbits;
+		fingerprints_ = filter_ + levels_[0] / value_nbits;
 
-		// Initialize cumulative rank count array.
+		// Initialize cumulative rank count array. Without it the keys are
+		// just counted.
 		size_t nblocks = (rank_space + block_nbits - 1) / block_nbits;
-		block_ranks_.resize(nblocks);
+		if (minimal)
+			block_ranks_.resize(nblocks);
 		for (rank_type b = 0; b < nblocks; b++) {
-			block_ranks_[b] = max_rank_;
+			if (minimal)
+				block_ranks_[b] = max_rank_;
 			for (rank_type v = 0; v < block_nvalues; v++) {
 				rank_type i = b * block_nvalues + v;
-				max_rank_ += __builtin_popcountll(bitset_[i]);
+				if (i < filter_)
+					max_rank_ += __builtin_popcountll(bitset_[i]);
 			}
 		}
+
+		// The extra keys take the positions after the levels.
+		slot_offset_ = rank_space - max_rank_;
+
+		// Check if there is a fingerprint for each rank.
+		if (bitset_.size() != fingerprints_ + bits::nwords(max_rank_ * fingerprint_bits_))
+			throw std::invalid_argument("fingerprint array size mismatch");
+
+		for (std::size_t i = 0; i < remap_.size(); i++) {
+			if (i == 0 ? remap_[i].internal != 0
+				   : remap_[i].internal <= remap_[i - 1].internal)
+				throw std::invalid_argument("invalid rank remap table");
+		}
 	}
 
 	rank_type insert(const key_type &key)
@@ -74,72 +178,230 @@ public:
 		if (rank == not_found) {
 			rank = max_rank_++;
 			extra_keys_.emplace(std::make_pair(key, rank));
+			if (!prefilter_.empty())
+				prefilter_.insert(hasher_(key, 0));
 #if PHF_DEBUG > 0
 			std::cerr << "extra rank " << rank << " for key " << key << '\n';
 #endif
+			if (!minimal)
+				rank += slot_offset_;
 		}
 		return rank;
 	}
 
+	// Set the prefilter. It must contain the level 0 hash values of all
+	// the keys.
+	void set_prefilter(blocked_bloom &&prefilter)
+	{
+		prefilter_ = std::move(prefilter);
+	}
+
+	// Insert an extra key with a known rank. This is used to restore
+	// a serialized or an updated function.
+	void insert_extra(const key_type &key, rank_type rank)
+	{
+		if (!extra_keys_.emplace(std::make_pair(key, rank)).second)
+			throw std::invalid_argument("duplicate extra key");
+		max_rank_++;
+	}
+
 	rank_type size() const
 	{
 		return max_rank_;
 	}
 
-	std::size_t operator[](const key_type &key) const
+	// Get the range of the lookup results. For a minimal function this
+	// is the same as size().
+	rank_type slot_count() const
 	{
-		hasher_ = key;
+		return minimal ? max_rank_ : max_rank_ + slot_offset_;
+	}
 
-		auto base = levels_[0];
-		auto hash = hasher_[0];
-		auto bit_index = hash & (base - 1);
-		auto index = bit_index / value_nbits;
-		auto shift = bit_index % value_nbits;
-		auto mask = UINT64_C(1) << shift;
-		auto value = bitset_[index];
-		if ((value & mask) != 0)
-			return get_rank(index, value, mask);
+	// Translate a lookup result to the key rank. For a function that is
+	// not minimal this takes a pass over the bitset up to the position so
+	// it is meant for occasional compaction rather than lookups.
+	std::size_t slot_rank(std::size_t slot) const
+	{
+		if (minimal)
+			return slot;
+		if (slot >= max_rank_ + slot_offset_ - extra_keys_.size())
+			return slot - slot_offset_;
+		std::size_t rank = 0;
+		for (std::size_t i = 0; i < slot / value_nbits; i++)
+			rank += __builtin_popcountll(bitset_[i]);
+		auto mask = (UINT64_C(1) << (slot % value_nbits)) - 1;
+		return rank + __builtin_popcountll(bitset_[slot / value_nbits] & mask);
+	}
 
-		if ((bitset_[filter_ + index] & mask) == 0)
-			return not_found;
+	std::size_t memory_size() const
+	{
+		return bitset_.size() * sizeof(bitset_value_type)
+		       + block_ranks_.size() * sizeof(rank_type)
+		       + remap_.size() * sizeof(remap_entry)
+		       + prefilter_.memory_size();
+	}
 
-		for (std::size_t level = 1; level < count; level++) {
-			auto size = levels_[level];
-			if (size == 0)
-				break;
+	unsigned fingerprint_bits() const
+	{
+		return fingerprint_bits_;
+	}
 
-			hash = hasher_[level];
-			bit_index = base + (hash & (size - 1));
-			index = bit_index / value_nbits;
-			shift = bit_index % value_nbits;
-			mask = UINT64_C(1) << shift;
-			value = bitset_[index];
-			if ((value & mask) != 0)
-				return get_rank(index, value, mask);
+	const hasher_type &key_hasher() const
+	{
+		return hasher_;
+	}
 
-			if (level < 2) {
-				bit_index = hash & (levels_[0] - 1);
-				index = bit_index / value_nbits;
-				shift = bit_index % value_nbits;
-				mask = UINT64_C(1) << shift;
-				if ((bitset_[filter_ + index] & mask) == 0)
-					return not_found;
-			}
+	const std::array<rank_type, count> &levels() const
+	{
+		return levels_;
+	}
 
-			base += size;
+	const bitset_type &bitset() const
+	{
+		return bitset_;
+	}
+
+	const remap_type &remap() const
+	{
+		return remap_;
+	}
+
+	const blocked_bloom &prefilter() const
+	{
+		return prefilter_;
+	}
+
+	const std::unordered_map<key_type, rank_type> &extra_keys() const
+	{
+		return extra_keys_;
+	}
+
+	// Translate a bitset rank to the external one.
+	std::size_t external_rank(std::size_t rank) const
+	{
+		if (remap_.empty())
+			return rank;
+		// Find the last run that starts at the rank or before it. The
+		// first run starts at zero. The search has no data-dependent
+		// branches so it does not stall on mispredictions.
+		const remap_entry *run = remap_.data();
+		for (std::size_t n = remap_.size(); n > 1;) {
+			std::size_t half = n / 2;
+			run = run[half].internal <= rank ? run + half : run;
+			n -= half;
 		}
+		return run->external + (rank - run->internal);
+	}
 
-		if (enable_extra_keys && !extra_keys_.empty()) {
-			auto it = extra_keys_.find(key);
-			if (it != extra_keys_.end())
-				return it->second;
+	// Find the index of the bit that corresponds to the key in the
+	// bitset or not_found if there is no such bit.
+	std::size_t position(const key_type &key) const
+	{
+		return lookup_bit(key, hasher_(key, 0));
+	}
+
+	// Get the bitset rank for the given bit index.
+	std::size_t bit_rank(std::size_t bit_index) const
+	{
+		if (!minimal)
+			return slot_rank(bit_index);
+		auto index = bit_index / value_nbits;
+		auto mask = UINT64_C(1) << (bit_index % value_nbits);
+		return get_rank(index, bitset_[index], mask);
+	}
+
+	// Compute a key fingerprint of the given size from its level 0 hash
+	// value. The high bits are used as the low ones select the bit.
+	static std::uint64_t fingerprint(std::uint64_t hash, unsigned nbits)
+	{
+		constexpr unsigned hash_nbits = 8 * sizeof(typename hasher_type::result_type);
+		return (hash >> (hash_nbits - nbits)) & bits::mask(nbits);
+	}
+
+	// Find the key rank verifying the key fingerprint. Without the
+	// fingerprints this is the same as operator[].
+	std::size_t find(const key_type &key) const
+	{
+		return lookup(key, hasher_(key, 0), true);
+	}
+
+	bool contains(const key_type &key) const
+	{
+		return find(key) != not_found;
+	}
+
+	std::size_t operator[](const key_type &key) const
+	{
+		return lookup(key, hasher_(key, 0), false);
+	}
+
+	//
+	// Look up a key given in another form that the hasher accepts and
+	// hashes the same as the key itself, for instance a composite key
+	// with byte_span fields in place of strings. So the lookup does not
+	// need to build a key_type object. It is only built to check the
+	// extra keys.
+	//
+	template <typename K, std::enable_if_t<is_key_view<K>::value, int> = 0>
+	std::size_t find(const K &key) const
+	{
+		return lookup(key, hasher_(key, 0), true);
+	}
+
+	template <typename K, std::enable_if_t<is_key_view<K>::value, int> = 0>
+	bool contains(const K &key) const
+	{
+		return find(key) != not_found;
+	}
+
+	template <typename K, std::enable_if_t<is_key_view<K>::value, int> = 0>
+	std::size_t operator[](const K &key) const
+	{
+		return lookup(key, hasher_(key, 0), false);
+	}
+
+	//
+	// The same as operator[] but the level 0 and level 1 words along with
+	// the filter word and the rank directory entries for both levels are
+	// loaded at once instead of one after another. So a key on level 1
+	// takes about one memory round-trip rather than two. This is useful
+	// for single lookups in tables much larger than the cache while for
+	// smaller ones the extra work makes it slower.
+	//
+	std::size_t speculative_lookup(const key_type &key) const
+	{
+		auto hash = hasher_(key, 0);
+		if (levels_[1] == 0)
+			return lookup(key, hash, false);
+
+		std::size_t index0 = hash & (levels_[0] - 1);
+		std::size_t index1 = levels_[0] + (hasher_(key, 1) & (levels_[1] - 1));
+		if (minimal) {
+			__builtin_prefetch(&block_ranks_[index0 / block_nbits]);
+			__builtin_prefetch(&block_ranks_[index1 / block_nbits]);
 		}
+		auto word0 = bitset_[index0 / value_nbits];
+		auto word1 = bitset_[index1 / value_nbits];
+		auto filter = bitset_[filter_ + index0 / value_nbits];
 
-		return not_found;
+		// A level 1 bit only counts if the level 0 filter bit is set.
+		bool hit0 = (word0 >> (index0 % value_nbits)) & 1;
+		bool hit1 = (word1 >> (index1 % value_nbits)) & (filter >> (index0 % value_nbits))
+			    & 1;
+		if (!(hit0 | hit1))
+			return lookup(key, hash, false);
+
+		if (!minimal)
+			return hit0 ? index0 : index1;
+		return external_rank(bit_rank(hit0 ? index0 : index1));
 	}
 
+	// Emit the C++ code for a statically initialized hash function. The
+	// extra keys if any are inserted by the generated constructor and
+	// written with the given key formatter.
+	template <typename KeyFormat = emit_literal_fn>
 	void emit(std::ostream &os, const std::string &name, const std::string &key_type_name,
-		  const std::string &hasher_type_name)
+		  const std::string &hasher_type_name, KeyFormat key_format = KeyFormat()) const
 	{
 		// Find out how many levels are really needed.
 		std::size_t required_count = count;
@@ -150,57 +412,236 @@ public:
 		std::string emit_class = "phf::minimal_perfect_hash<";
 		emit_class += emit_count + ", " + key_type_name + ", " + hasher_type_name;
 		emit_class += ", std::size_t, static_bitset, ";
-		emit_class += extra_keys_.empty() ? "false>" : "true>";
+		emit_class += extra_keys_.empty() ? "false" : "true";
+		emit_class += minimal ? ">" : ", false>";
+
+		std::string emit_args = "static_hasher, static_levels, static_bitset()";
+		if (fingerprint_bits_ != 0 || !remap_.empty())
+			emit_args += ", " + std::to_string(fingerprint_bits_);
+		if (!remap_.empty()) {
+			emit_args += ", remap_type {{";
+			for (const auto &e : remap_) {
+				emit_args += "{" + std::to_string(e.internal) + ", "
+					     + std::to_string(e.external) + "}, ";
+			}
+			emit_args += "}}";
+		}
 
 		os << "namespace " << name << " {\n\n";
-		os << "static constexpr std::size_t static_bitset_size = " << bitset_.size()
-		   << ";\n\n";
-		os << "phf::hasher<" << emit_count << ", " << key_type_name << ", "
-		   << hasher_type_name << "> static_hasher(std::array<std::uint64_t, "
-		   << emit_count << "> {{\n\t0x" << std::hex;
-		for (std::size_t i = 0; i < required_count; i++) {
-			os << hasher_.seeds()[i];
-			if (i != (required_count - 1))
-				os << ", 0x";
-		}
-		os << std::dec << "\n}});\n\n";
+		emit_static_hasher(os, required_count, key_type_name, hasher_type_name,
+				   hasher_.seeds());
 		os << "std::array<std::size_t, " << emit_count << "> static_levels {{\n\t";
 		for (std::size_t i = 0; i < required_count; i++)
 			os << levels_[i] << ", ";
 		os << "\n}};\n\n";
-		os << "std::array<std::uint64_t, static_bitset_size> static_bitset_data {{\n";
-		for (auto value : bitset_)
-			os << "\t0x" << std::hex << value << std::dec << ",\n";
-		os << "}};\n\n";
-		os << "struct static_bitset {\n";
-		os << "\tusing value_type = std::uint64_t;\n";
-		os << "\tusing iterator = std::uint64_t *;\n";
-		os << "\tusing const_iterator = const std::uint64_t *;\n";
-		os << "\tstd::size_t size() { return static_bitset_data.size(); }\n";
-		os << "\tvalue_type& operator[](std::size_t i) { return static_bitset_data[i]; "
-		      "}\n";
-		os << "\tconst value_type& operator[](std::size_t i) const { return "
-		      "static_bitset_data[i]; }\n";
-		os << "};\n\n";
+		emit_static_bitset(os, bitset_);
+		if (!prefilter_.empty()) {
+			const auto &words = prefilter_.words();
+			os << "std::vector<std::uint64_t> static_prefilter {\n";
+			for (std::size_t i = 0; i < words.size(); i++)
+				os << "\t0x" << std::hex << words[i] << std::dec << ",\n";
+			os << "};\n\n";
+		}
 		os << "struct mph : " << emit_class << " {\n";
 		os << "\tmph() : " << emit_class
-		   << "(static_hasher, static_levels, static_bitset())"
+		   << "(" << emit_args << ")"
 		   << " {\n";
+		if (!prefilter_.empty()) {
+			os << "\t\tset_prefilter(phf::blocked_bloom(" << prefilter_.nhashes()
+			   << ", std::move(static_prefilter)));\n";
+		}
+		for (const auto *item : sorted_extra_keys()) {
+			os << "\t\tinsert_extra(";
+			key_format(os, item->first);
+			os << ", " << item->second << ");\n";
+		}
 		os << "\t}\n";
 		os << "} instance;\n\n";
 		os << "} // namespace " << name << "\n\n";
 	}
 
+	void write(std::ostream &os) const
+	{
+		io::write_tag(os, tag);
+		io::write(os, hasher_.seeds());
+		io::write(os, levels_);
+		io::write(os, fingerprint_bits_);
+		io::write(os, bitset_);
+		io::write(os, remap_);
+		prefilter_.write(os);
+
+		auto extra = sorted_extra_keys();
+		io::write(os, std::uint64_t{extra.size()});
+		for (const auto *item : extra) {
+			io::write(os, item->first);
+			io::write(os, std::uint64_t{item->second});
+		}
+	}
+
+	static std::unique_ptr<minimal_perfect_hash> read(std::istream &is)
+	{
+		typename hasher_type::seed_array_type seeds;
+		std::array<rank_type, count> levels;
+		unsigned fingerprint_bits;
+		bitset_type bitset;
+		remap_type remap;
+		blocked_bloom prefilter;
+		io::read_tag(is, tag);
+		io::read(is, seeds);
+		io::read(is, levels);
+		io::read(is, fingerprint_bits);
+		io::read(is, bitset);
+		io::read(is, remap);
+		prefilter.read(is);
+
+		auto result = std::make_unique<minimal_perfect_hash>(
+			hasher_type(seeds), levels, std::move(bitset), fingerprint_bits,
+			std::move(remap));
+		result->set_prefilter(std::move(prefilter));
+
+		std::uint64_t nextra;
+		io::read(is, nextra);
+		for (std::uint64_t i = 0; i < nextra; i++) {
+			key_type key;
+			std::uint64_t rank;
+			io::read(is, key);
+			io::read(is, rank);
+			result->insert_extra(key, rank);
+		}
+		return result;
+	}
+
 private:
-	mutable hasher_type hasher_;
+	hasher_type hasher_;
 	std::array<rank_type, count> levels_;
 	bitset_type bitset_;
 
 	rank_type filter_;
+	rank_type fingerprints_;
+	unsigned fingerprint_bits_;
 	rank_type max_rank_;
-	std::vector<rank_type> block_ranks_;
+	typename bitset_storage<bitset_type, rank_type>::type block_ranks_;
+	remap_type remap_;
+	// The difference of the positions and the ranks of the extra keys.
+	rank_type slot_offset_;
+
+	blocked_bloom prefilter_;
+
 	std::unordered_map<key_type, rank_type> extra_keys_;
 
+	auto find_extra(const key_type &key) const
+	{
+		return extra_keys_.find(key);
+	}
+
+	template <typename K,
+		  std::enable_if_t<std::is_constructible<key_type, const K &>::value, int> = 0>
+	auto find_extra(const K &key) const
+	{
+		return extra_keys_.find(key_type(key));
+	}
+
+	// Only used without extra keys, see is_key_view.
+	template <typename K,
+		  std::enable_if_t<!std::is_constructible<key_type, const K &>::value, int> = 0>
+	auto find_extra(const K &) const
+	{
+		return extra_keys_.end();
+	}
+
+	// Find the key rank given its level 0 hash value optionally checking
+	// the key fingerprint. The hash values for the other levels are
+	// computed as needed. As the lookup does not modify the object it
+	// might be used from multiple threads.
+	template <typename K>
+	std::size_t lookup(const K &key, typename hasher_type::result_type hash, bool verify) const
+	{
+		// A membership check starts with the prefilter. Otherwise it is
+		// only checked for the keys that pass the conflict filter.
+		if (verify && !prefilter_.empty() && !prefilter_.contains(hash))
+			return not_found;
+
+		auto bit_index = lookup_bit(key, hash, !verify);
+		if (!minimal && bit_index != not_found)
+			return bit_index;
+		if (bit_index != not_found) {
+			auto rank = bit_rank(bit_index);
+			if (verify && fingerprint_bits_ != 0) {
+				auto offset = fingerprints_ * value_nbits + rank * fingerprint_bits_;
+				auto expected = bits::get(bitset_, offset, fingerprint_bits_);
+				if (fingerprint(hash, fingerprint_bits_) != expected)
+					return not_found;
+			}
+			return external_rank(rank);
+		}
+
+		if (enable_extra_keys && !extra_keys_.empty()) {
+			auto it = find_extra(key);
+			if (it != extra_keys_.end())
+				return minimal ? it->second : it->second + slot_offset_;
+		}
+
+		return not_found;
+	}
+
+	template <typename K>
+	std::size_t lookup_bit(const K &key, typename hasher_type::result_type hash,
+			       bool prefilter = true) const
+	{
+		auto base = levels_[0];
+		auto bit_index = hash & (base - 1);
+		auto index = bit_index / value_nbits;
+		auto shift = bit_index % value_nbits;
+		auto mask = UINT64_C(1) << shift;
+		auto value = bitset_[index];
+		if ((value & mask) != 0)
+			return bit_index;
+
+		if ((bitset_[filter_ + index] & mask) == 0)
+			return not_found;
+		if (prefilter && !prefilter_.empty() && !prefilter_.contains(hash))
+			return not_found;
+
+		for (std::size_t level = 1; level < count; level++) {
+			auto size = levels_[level];
+			if (size == 0)
+				break;
+
+			hash = hasher_(key, level);
+			bit_index = base + (hash & (size - 1));
+			index = bit_index / value_nbits;
+			shift = bit_index % value_nbits;
+			mask = UINT64_C(1) << shift;
+			value = bitset_[index];
+			if ((value & mask) != 0)
+				return bit_index;
+
+			if (level < 2) {
+				bit_index = hash & (levels_[0] - 1);
+				index = bit_index / value_nbits;
+				shift = bit_index % value_nbits;
+				mask = UINT64_C(1) << shift;
+				if ((bitset_[filter_ + index] & mask) == 0)
+					return not_found;
+			}
+
+			base += size;
+		}
+
+		return not_found;
+	}
+
+	// Get the extra keys in the rank order.
+	std::vector<const std::pair<const key_type, rank_type> *> sorted_extra_keys() const
+	{
+		std::vector<const std::pair<const key_type, rank_type> *> extra;
+		for (const auto &item : extra_keys_)
+			extra.push_back(&item);
+		std::sort(extra.begin(), extra.end(),
+			  [](const auto *a, const auto *b) { return a->second < b->second; });
+		return extra;
+	}
+
 	std::size_t get_rank(std::size_t index, std::uint64_t value, std::uint64_t mask) const
 	{
 		rank_type rank = block_ranks_[index / block_nvalues];
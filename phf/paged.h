@@ -0,0 +1,541 @@
+#ifndef PERFECT_HASH_PAGED_H
+#define PERFECT_HASH_PAGED_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "bits.h"
+#include "hasher.h"
+#include "serialize.h"
+
+namespace phf {
+
+//
+// An allocator that aligns blocks to the memory page size so that each
+// page of a paged_mph bitset falls into a single memory page.
+//
+template <typename T>
+class page_allocator
+{
+public:
+	using value_type = T;
+
+	static constexpr std::size_t alignment = 4096;
+
+	page_allocator() noexcept = default;
+
+	template <typename U>
+	page_allocator(const page_allocator<U> &) noexcept
+	{
+	}
+
+	T *allocate(std::size_t n)
+	{
+		void *p;
+		if (posix_memalign(&p, alignment, n * sizeof(T)) != 0)
+			throw std::bad_alloc();
+		return static_cast<T *>(p);
+	}
+
+	void deallocate(T *p, std::size_t) noexcept
+	{
+		std::free(p);
+	}
+};
+
+template <typename T, typename U>
+bool
+operator==(const page_allocator<T> &, const page_allocator<U> &)
+{
+	return true;
+}
+
+template <typename T, typename U>
+bool
+operator!=(const page_allocator<T> &, const page_allocator<U> &)
+{
+	return false;
+}
+
+using page_bitset = std::vector<std::uint64_t, page_allocator<std::uint64_t>>;
+
+//
+// A minimal perfect hash function object with a page-local layout. The
+// level 0 hash value picks a 4KB page and all the levels and the conflict
+// filter for the keys of this page are stored within it, much like in a
+// blocked Bloom filter. So a lookup touches a single memory page and thus
+// a single TLB entry and a few cache lines of it whatever level the key
+// takes. With the multi-level minimal_perfect_hash a key on level 2 costs
+// separate pages for each level, the filter and the rank directory.
+//
+// All the pages have the same layout. The first two cache lines hold the
+// rank of the first key of the page and the number of set bits before each
+// of the other cache lines. The rest holds the levels followed by the
+// conflict filter for level 0. The level sizes are chosen for somewhat
+// more keys than the average page gets so the keys that are left over
+// after the last level are rare. They are kept in a hash table as the
+// extra keys of minimal_perfect_hash and take the ranks after the others.
+//
+// The page layout only pays off if the bitset is page aligned as with
+// page_bitset or huge_page_bitset.
+//
+template <std::size_t N, typename Key, typename Hash = std::hash<Key>,
+	  typename Rank = std::size_t, typename Bitset = page_bitset>
+class paged_mph
+{
+public:
+	using key_type = Key;
+	using rank_type = Rank;
+	using base_hasher_type = Hash;
+	using hasher_type = hasher<N, key_type, base_hasher_type>;
+	using bitset_type = Bitset;
+
+	static constexpr rank_type count = hasher_type::count;
+
+	using bitset_value_type = typename bitset_type::value_type;
+	static_assert(sizeof(bitset_value_type) == 8, "invalid value type");
+
+	static constexpr std::size_t value_nbits = 8 * sizeof(bitset_value_type);
+	static constexpr std::size_t line_nwords = 8;
+	static constexpr std::size_t line_nbits = line_nwords * value_nbits;
+	static constexpr std::size_t page_nwords = 512;
+	static constexpr std::size_t header_nwords = 2 * line_nwords;
+	static constexpr std::size_t data_nwords = page_nwords - header_nwords;
+	static constexpr std::size_t data_nbits = data_nwords * value_nbits;
+
+	// The header consists of 16-bit fields. The first three hold the page
+	// base rank and each of the others the bit count before a data line
+	// starting with the second one.
+	static constexpr unsigned field_nbits = 16;
+	static constexpr unsigned base_nfields = 3;
+	static_assert(base_nfields + data_nwords / line_nwords - 1
+			      == header_nwords * value_nbits / field_nbits,
+		      "invalid page header layout");
+
+	// The serialized object tag: "PAGEMPH1".
+	static constexpr std::uint64_t tag = UINT64_C(0x3148504d45474150);
+
+	paged_mph(const hasher_type &hasher, std::array<rank_type, count> levels,
+		  rank_type npages, bitset_type &&bitset)
+		: hasher_(hasher), levels_(levels), offsets_{{0}}, filter_(0), npages_(npages),
+		  size_(0), bitset_(std::move(bitset))
+	{
+		if (npages_ == 0)
+			throw std::invalid_argument("page number must be positive");
+		if (bitset_.size() != npages_ * page_nwords)
+			throw std::invalid_argument("bitset size must match the page number");
+
+		std::size_t offset = 0;
+		for (std::size_t i = 0; i < count; i++) {
+			if (levels_[i] % value_nbits != 0 || (i == 0 && levels_[i] == 0))
+				throw std::invalid_argument("invalid level size");
+			offsets_[i] = offset;
+			offset += levels_[i];
+		}
+		filter_ = offset;
+		if (filter_ + levels_[0] > data_nbits)
+			throw std::invalid_argument("levels do not fit a page");
+
+		// The last page base plus its bit count gives the number of keys.
+		const auto *page = &bitset_[(npages_ - 1) * page_nwords];
+		size_ = page_base(page);
+		for (std::size_t i = 0; i < filter_ / value_nbits; i++)
+			size_ += __builtin_popcountll(page[header_nwords + i]);
+	}
+
+	// Insert an extra key with a known rank. This is used to restore
+	// a serialized function.
+	void insert_extra(const key_type &key, rank_type rank)
+	{
+		if (!extra_keys_.emplace(std::make_pair(key, rank)).second)
+			throw std::invalid_argument("duplicate extra key");
+		size_++;
+	}
+
+	rank_type size() const
+	{
+		return size_;
+	}
+
+	std::size_t memory_size() const
+	{
+		return bitset_.size() * sizeof(bitset_value_type);
+	}
+
+	rank_type npages() const
+	{
+		return npages_;
+	}
+
+	const std::array<rank_type, count> &levels() const
+	{
+		return levels_;
+	}
+
+	const bitset_type &bitset() const
+	{
+		return bitset_;
+	}
+
+	const std::unordered_map<key_type, rank_type> &extra_keys() const
+	{
+		return extra_keys_;
+	}
+
+	// Map a hash value to a position within the given number of bits.
+	// The low half is used as the high bits of the level 0 hash value
+	// select the page.
+	static std::size_t position(std::uint64_t hash, std::size_t nbits)
+	{
+		return bits::reduce32(hash, nbits);
+	}
+
+	std::size_t page_index(std::uint64_t hash) const
+	{
+		return bits::reduce64(hash, npages_);
+	}
+
+	std::size_t operator[](const key_type &key) const
+	{
+		auto hash = hasher_(key, 0);
+		const auto *page = &bitset_[page_index(hash) * page_nwords];
+		const auto *data = page + header_nwords;
+
+		auto bit_index = position(hash, levels_[0]);
+		if (test(data, bit_index))
+			return page_rank(page, bit_index);
+		if (!test(data, filter_ + bit_index))
+			return not_found;
+
+		for (std::size_t level = 1; level < count; level++) {
+			auto size = levels_[level];
+			if (size == 0)
+				break;
+			bit_index = offsets_[level] + position(hasher_(key, level), size);
+			if (test(data, bit_index))
+				return page_rank(page, bit_index);
+		}
+
+		if (!extra_keys_.empty()) {
+			auto it = extra_keys_.find(key);
+			if (it != extra_keys_.end())
+				return it->second;
+		}
+
+		return not_found;
+	}
+
+	void write(std::ostream &os) const
+	{
+		io::write_tag(os, tag);
+		io::write(os, hasher_.seeds());
+		io::write(os, levels_);
+		io::write(os, npages_);
+		io::write(os, bitset_);
+
+		std::vector<std::pair<key_type, rank_type>> extra(extra_keys_.begin(),
+								  extra_keys_.end());
+		std::sort(extra.begin(), extra.end(),
+			  [](const auto &a, const auto &b) { return a.second < b.second; });
+		io::write(os, std::uint64_t{extra.size()});
+		for (const auto &item : extra) {
+			io::write(os, item.first);
+			io::write(os, std::uint64_t{item.second});
+		}
+	}
+
+	static std::unique_ptr<paged_mph> read(std::istream &is)
+	{
+		typename hasher_type::seed_array_type seeds;
+		std::array<rank_type, count> levels;
+		rank_type npages;
+		bitset_type bitset;
+		io::read_tag(is, tag);
+		io::read(is, seeds);
+		io::read(is, levels);
+		io::read(is, npages);
+		io::read(is, bitset);
+
+		auto result = std::make_unique<paged_mph>(hasher_type(seeds), levels, npages,
+							  std::move(bitset));
+
+		std::uint64_t nextra;
+		io::read(is, nextra);
+		for (std::uint64_t i = 0; i < nextra; i++) {
+			key_type key;
+			std::uint64_t rank;
+			io::read(is, key);
+			io::read(is, rank);
+			result->insert_extra(key, rank);
+		}
+		return result;
+	}
+
+	static std::uint64_t page_field(const bitset_value_type *page, std::size_t index)
+	{
+		return (page[index / 4] >> (field_nbits * (index % 4))) & bits::mask(field_nbits);
+	}
+
+	static std::uint64_t page_base(const bitset_value_type *page)
+	{
+		return page[0] & bits::mask(base_nfields * field_nbits);
+	}
+
+private:
+	hasher_type hasher_;
+	std::array<rank_type, count> levels_;
+	// The bit offsets of the levels and the filter within the page data.
+	std::array<rank_type, count> offsets_;
+	rank_type filter_;
+	rank_type npages_;
+	rank_type size_;
+	bitset_type bitset_;
+
+	std::unordered_map<key_type, rank_type> extra_keys_;
+
+	static bool test(const bitset_value_type *data, std::size_t bit_index)
+	{
+		return (data[bit_index / value_nbits] >> (bit_index % value_nbits)) & 1;
+	}
+
+	// Get the rank for the given bit index within the page data. The
+	// counts only cover the cache lines before the one with the bit.
+	static std::size_t page_rank(const bitset_value_type *page, std::size_t bit_index)
+	{
+		auto line = bit_index / line_nbits;
+		auto index = bit_index / value_nbits;
+		std::size_t rank = page_base(page);
+		if (line != 0)
+			rank += page_field(page, base_nfields + line - 1);
+
+		const auto *data = page + header_nwords;
+		for (auto i = line * line_nwords; i < index; i++)
+			rank += __builtin_popcountll(data[i]);
+		auto mask = (UINT64_C(1) << (bit_index % value_nbits)) - 1;
+		return rank + __builtin_popcountll(data[index] & mask);
+	}
+};
+
+template <std::size_t N, typename Key, typename Hash = std::hash<Key>,
+	  typename Bitset = page_bitset>
+class paged_builder
+{
+public:
+	using key_type = Key;
+	using base_hasher_type = Hash;
+	using hasher_type = hasher<N, key_type, base_hasher_type>;
+
+	static constexpr std::size_t count = hasher_type::count;
+
+	using mph_type = paged_mph<count, key_type, base_hasher_type, std::size_t, Bitset>;
+	using rank_type = typename mph_type::rank_type;
+	using bitset_type = typename mph_type::bitset_type;
+
+	// The gamma parameter specifies how many bits per key are allocated
+	// on each level of a page as for the multi-level builder.
+	paged_builder(double gamma, std::uint64_t seed)
+		: gamma_(gamma), seed_(seed), hasher_(seed)
+	{
+		if (!(gamma_ >= 1))
+			throw std::invalid_argument("gamma must be at least 1");
+		layout(gamma_, levels_, page_size_);
+	}
+
+	void insert(const key_type &key)
+	{
+		keys_.insert(key);
+	}
+
+	std::unique_ptr<mph_type> build()
+	{
+		static constexpr auto page_nwords = mph_type::page_nwords;
+		static constexpr auto header_nwords = mph_type::header_nwords;
+		static constexpr auto line_nwords = mph_type::line_nwords;
+
+		std::size_t npages = (keys_.size() + page_size_ - 1) / page_size_;
+		npages = std::max(npages, std::size_t{1});
+
+		// Group the keys by pages.
+		std::vector<std::size_t> starts(npages + 1);
+		std::vector<std::pair<std::size_t, const key_type *>> entries;
+		entries.reserve(keys_.size());
+		for (const auto &key : keys_) {
+			std::size_t page = bits::reduce64(hasher_(key, 0), npages);
+			entries.emplace_back(page, &key);
+			starts[page + 1]++;
+		}
+		for (std::size_t p = 0; p < npages; p++)
+			starts[p + 1] += starts[p];
+		std::vector<const key_type *> keys(entries.size());
+		{
+			auto next = starts;
+			for (const auto &e : entries)
+				keys[next[e.first]++] = e.second;
+		}
+		entries.clear();
+		entries.shrink_to_fit();
+
+		bitset_type bitset(npages * page_nwords);
+		std::vector<const key_type *> extra;
+		std::vector<const key_type *> level_keys, next_keys;
+		std::vector<std::size_t> positions;
+		std::vector<std::uint8_t> counts;
+		std::size_t filter = filter_offset();
+		std::size_t rank = 0;
+#if PHF_DEBUG > 0
+		std::size_t max_page_size = 0;
+#endif
+		for (std::size_t p = 0; p < npages; p++) {
+			auto *page = &bitset[p * page_nwords];
+			auto *data = page + header_nwords;
+			level_keys.assign(keys.begin() + starts[p], keys.begin() + starts[p + 1]);
+#if PHF_DEBUG > 0
+			max_page_size = std::max(max_page_size, level_keys.size());
+#endif
+
+			std::size_t offset = 0;
+			for (std::size_t level = 0; level < count && !level_keys.empty(); level++) {
+				auto size = levels_[level];
+				if (size == 0)
+					break;
+
+				// Count the keys for each position up to two.
+				counts.assign(size, 0);
+				positions.clear();
+				for (const auto *key : level_keys) {
+					auto pos = mph_type::position(hasher_(*key, level), size);
+					positions.push_back(pos);
+					if (counts[pos] < 2)
+						counts[pos]++;
+				}
+
+				next_keys.clear();
+				for (std::size_t i = 0; i < level_keys.size(); i++) {
+					auto pos = positions[i];
+					if (counts[pos] == 1) {
+						set(data, offset + pos);
+					} else {
+						next_keys.push_back(level_keys[i]);
+						if (level == 0)
+							set(data, filter + pos);
+					}
+				}
+				level_keys.swap(next_keys);
+				offset += size;
+			}
+			extra.insert(extra.end(), level_keys.begin(), level_keys.end());
+
+			// Fill the page header.
+			page[0] = rank;
+			std::size_t page_rank = 0;
+			std::size_t field = mph_type::base_nfields;
+			for (std::size_t i = 0; i < filter / 64; i++) {
+				if (i != 0 && i % line_nwords == 0) {
+					auto field_nbits = mph_type::field_nbits;
+					bits::put(page, field * field_nbits, field_nbits, page_rank);
+					field++;
+				}
+				page_rank += __builtin_popcountll(data[i]);
+			}
+			rank += page_rank;
+		}
+
+#if PHF_DEBUG > 0
+		std::cerr << "paged: " << keys.size() << " keys, " << npages << " pages, "
+			  << max_page_size << " max page keys, " << extra.size()
+			  << " extra keys\n";
+#endif
+
+		auto result = std::make_unique<mph_type>(hasher_, levels_, npages,
+							 std::move(bitset));
+		for (const auto *key : extra)
+			result->insert_extra(*key, rank++);
+		return result;
+	}
+
+	void clear()
+	{
+		hasher_ = hasher_type(seed_);
+		keys_.clear();
+	}
+
+	// Get the number of keys per page the builder aims at.
+	std::size_t page_size() const
+	{
+		return page_size_;
+	}
+
+	//
+	// Find the level sizes for the given gamma and the average number of
+	// keys per page. The expected number of keys left after each level is
+	// estimated for the largest number of keys whose levels and filter fit
+	// a page. The average is then set three standard deviations below this
+	// number so the keys of a larger than average page still mostly fit.
+	//
+	static void layout(double gamma, std::array<rank_type, count> &levels,
+			   std::size_t &page_size)
+	{
+		static constexpr auto value_nbits = mph_type::value_nbits;
+
+		auto fill = [gamma](std::size_t nkeys, std::array<rank_type, count> &sizes) {
+			double remaining = nkeys;
+			std::size_t total = 0;
+			for (std::size_t level = 0; level < count; level++) {
+				std::size_t size = std::ceil(gamma * remaining / value_nbits);
+				sizes[level] = std::max(size, std::size_t{1}) * value_nbits;
+				total += sizes[level];
+				remaining *= 1 - std::exp(-remaining / sizes[level]);
+			}
+			return total + sizes[0];
+		};
+
+		std::size_t low = 1, high = mph_type::data_nbits;
+		while (low < high) {
+			auto middle = (low + high + 1) / 2;
+			if (fill(middle, levels) <= mph_type::data_nbits)
+				low = middle;
+			else
+				high = middle - 1;
+		}
+		fill(low, levels);
+		page_size = std::max(low - 3 * std::sqrt(low), 1.0);
+	}
+
+private:
+	const double gamma_;
+	const std::uint64_t seed_;
+	hasher_type hasher_;
+
+	std::array<rank_type, count> levels_;
+	std::size_t page_size_;
+
+	std::unordered_set<key_type> keys_;
+
+	std::size_t filter_offset() const
+	{
+		std::size_t offset = 0;
+		for (auto size : levels_)
+			offset += size;
+		return offset;
+	}
+
+	static void set(typename bitset_type::value_type *data, std::size_t bit_index)
+	{
+		data[bit_index / 64] |= UINT64_C(1) << (bit_index % 64);
+	}
+};
+
+} // namespace phf
+
+#endif // PERFECT_HASH_PAGED_H
@@ -0,0 +1,273 @@
+#ifndef PERFECT_HASH_PERFECT_MAP_H
+#define PERFECT_HASH_PERFECT_MAP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "builder.h"
+#include "emit.h"
+#include "mph.h"
+#include "serialize.h"
+
+namespace phf {
+
+//
+// A static key to value map based on a minimal perfect hash function.
+// The keys and values are kept in separate arrays in the rank order.
+//
+// If the keys are not stored then a lookup of a non-member key returns
+// an arbitrary value unless it is rejected by the key fingerprints of
+// the hash function.
+//
+template <typename Key, typename Value, typename Hash = std::hash<Key>, bool store_keys = true,
+	  typename Mph = typename builder<16, Key, Hash>::mph_type,
+	  typename KeyArray = std::vector<Key>, typename ValueArray = std::vector<Value>>
+class perfect_map
+{
+public:
+	using key_type = Key;
+	using mapped_type = Value;
+	using mph_type = Mph;
+	using key_array_type = KeyArray;
+	using value_array_type = ValueArray;
+
+	// The serialized object tag: "PERFMAP1".
+	static constexpr std::uint64_t tag = UINT64_C(0x3150414d46524550);
+
+	// The number of keys looked up together by the batch find().
+	static constexpr std::size_t batch_size = 16;
+
+	perfect_map(mph_type &&mph, key_array_type &&keys, value_array_type &&values)
+		: mph_(std::move(mph)), keys_(std::move(keys)), values_(std::move(values))
+	{
+		if (values_.size() != mph_.size())
+			throw std::invalid_argument("value array size mismatch");
+		if (keys_.size() != (store_keys ? values_.size() : 0))
+			throw std::invalid_argument("key array size mismatch");
+	}
+
+	std::size_t size() const
+	{
+		return values_.size();
+	}
+
+	std::size_t memory_size() const
+	{
+		return mph_.memory_size() + keys_.size() * sizeof(key_type)
+		       + values_.size() * sizeof(mapped_type);
+	}
+
+	const mph_type &mph() const
+	{
+		return mph_;
+	}
+
+	const key_array_type &keys() const
+	{
+		return keys_;
+	}
+
+	const value_array_type &values() const
+	{
+		return values_;
+	}
+
+	const mapped_type *find(const key_type &key) const
+	{
+		return lookup(key, mph_.find(key));
+	}
+
+	// Look up a range of keys storing a value pointer or nullptr for
+	// each one to the output iterator. The ranks are found for a batch
+	// of keys first so that the key and value array accesses for the
+	// batch overlap.
+	template <typename ForwardIt, typename OutputIt>
+	OutputIt find(ForwardIt first, ForwardIt last, OutputIt out) const
+	{
+		std::size_t ranks[batch_size];
+		while (first != last) {
+			std::size_t n = 0;
+			for (auto it = first; n < batch_size && it != last; ++it, ++n) {
+				auto rank = mph_.find(*it);
+				if (rank < values_.size()) {
+					if (store_keys)
+						__builtin_prefetch(&keys_[rank]);
+					__builtin_prefetch(&values_[rank]);
+				}
+				ranks[n] = rank;
+			}
+			for (std::size_t i = 0; i < n; i++, ++first)
+				*out++ = lookup(*first, ranks[i]);
+		}
+		return out;
+	}
+
+	bool contains(const key_type &key) const
+	{
+		return find(key) != nullptr;
+	}
+
+	const mapped_type &at(const key_type &key) const
+	{
+		auto value = find(key);
+		if (value == nullptr)
+			throw std::out_of_range("key not found");
+		return *value;
+	}
+
+	//
+	// Emit the C++ code for a statically initialized map named
+	// map_instance along with the hash function it is based on. Keys
+	// and values are written with the given formatters.
+	//
+	template <typename KeyFormat = emit_literal_fn, typename ValueFormat = emit_literal_fn>
+	void emit(std::ostream &os, const std::string &name, const std::string &key_type_name,
+		  const std::string &value_type_name, const std::string &hasher_type_name,
+		  KeyFormat key_format = KeyFormat(), ValueFormat value_format = ValueFormat()) const
+	{
+		mph_.emit(os, name, key_type_name, hasher_type_name);
+
+		std::string key_array = "std::array<" + key_type_name + ", "
+					+ std::to_string(keys_.size()) + ">";
+		std::string value_array = "std::array<" + value_type_name + ", "
+					  + std::to_string(values_.size()) + ">";
+		std::string emit_class = "phf::perfect_map<" + key_type_name + ", "
+					 + value_type_name + ", " + hasher_type_name + ", "
+					 + (store_keys ? "true" : "false") + ", map_mph, " + key_array
+					 + ", " + value_array + ">";
+
+		// The mph name is hidden by the mph() method in the map scope.
+		os << "namespace " << name << " {\n\n";
+		os << "using map_mph = mph;\n\n";
+		os << "struct map : " << emit_class << " {\n";
+		os << "\tmap() : " << emit_class << "(map_mph(), " << key_array << " {{\n";
+		for (const auto &key : keys_) {
+			os << "\t\t";
+			key_format(os, key);
+			os << ",\n";
+		}
+		os << "\t}}, " << value_array << " {{\n";
+		for (const auto &value : values_) {
+			os << "\t\t";
+			value_format(os, value);
+			os << ",\n";
+		}
+		os << "\t}}) {\n";
+		os << "\t}\n";
+		os << "} map_instance;\n\n";
+		os << "} // namespace " << name << "\n\n";
+	}
+
+	void write(std::ostream &os) const
+	{
+		io::write_tag(os, tag);
+		mph_.write(os);
+		if (store_keys)
+			io::write(os, keys_);
+		io::write(os, values_);
+	}
+
+	static std::unique_ptr<perfect_map> read(std::istream &is)
+	{
+		key_array_type keys;
+		value_array_type values;
+		io::read_tag(is, tag);
+		auto mph = mph_type::read(is);
+		if (store_keys)
+			io::read(is, keys);
+		io::read(is, values);
+		return std::make_unique<perfect_map>(std::move(*mph), std::move(keys),
+						     std::move(values));
+	}
+
+private:
+	mph_type mph_;
+	key_array_type keys_;
+	value_array_type values_;
+
+	const mapped_type *lookup(const key_type &key, std::size_t rank) const
+	{
+		if (rank >= values_.size())
+			return nullptr;
+		if (store_keys && !(keys_[rank] == key))
+			return nullptr;
+		return &values_[rank];
+	}
+};
+
+//
+// A builder for the static key to value maps.
+//
+template <typename Key, typename Value, typename Hash = std::hash<Key>, bool store_keys = true>
+class perfect_map_builder
+{
+public:
+	using key_type = Key;
+	using mapped_type = Value;
+	using builder_type = builder<16, key_type, Hash>;
+	using map_type =
+		perfect_map<key_type, mapped_type, Hash, store_keys, typename builder_type::mph_type>;
+
+	perfect_map_builder(double gamma, std::uint64_t seed, unsigned fingerprint_bits = 0)
+		: builder_(gamma, seed, fingerprint_bits)
+	{
+	}
+
+	// Insert a key value pair. The value of a repeated key replaces
+	// the previous one.
+	void insert(const key_type &key, const mapped_type &value)
+	{
+		auto result = entries_.emplace(key, value);
+		if (!result.second)
+			result.first->second = value;
+	}
+
+	std::unique_ptr<map_type> build()
+	{
+		for (const auto &entry : entries_)
+			builder_.insert(entry.first);
+
+		// Put the entries in the rank order as the builder reports it.
+		std::vector<const typename entry_map::value_type *> order(entries_.size());
+		auto mph = builder_.build([&](const key_type &key, std::size_t rank) {
+			order[rank] = &*entries_.find(key);
+		});
+
+		typename map_type::key_array_type keys;
+		typename map_type::value_array_type values;
+		if (store_keys)
+			keys.reserve(order.size());
+		values.reserve(order.size());
+		for (const auto *entry : order) {
+			if (store_keys)
+				keys.push_back(entry->first);
+			values.push_back(entry->second);
+		}
+
+		return std::make_unique<map_type>(std::move(*mph), std::move(keys),
+						  std::move(values));
+	}
+
+	void clear()
+	{
+		builder_.clear();
+		entries_.clear();
+	}
+
+private:
+	using entry_map = std::unordered_map<key_type, mapped_type>;
+
+	builder_type builder_;
+	entry_map entries_;
+};
+
+} // namespace phf
+
+#endif // PERFECT_HASH_PERFECT_MAP_H
@@ -0,0 +1,97 @@
+#ifndef PERFECT_HASH_PREHASHED_H
+#define PERFECT_HASH_PREHASHED_H
+
+#include <cstdint>
+#include <functional>
+#include <ios>
+#include <iostream>
+
+#include "bits.h"
+
+namespace phf {
+
+//
+// A key given by a 64-bit or 128-bit hash value that the caller computed
+// for other purposes such as sharding. A function built for these keys
+// derives the hash values for all its levels from this value with a
+// single mixing step so the original key is never read. Its size does
+// not matter for the lookup and the build does not hash the keys again.
+//
+// The function then cannot tell the keys with the same hash value apart,
+// and it does not verify the keys. The caller might verify them if it
+// stores them elsewhere.
+//
+//   phf::builder<16, phf::prehashed> builder(2, seed);
+//   builder.insert(phf::prehashed(shard_hash(key)));
+//   ...
+//   auto rank = (*mph)[phf::prehashed(shard_hash(key))];
+//
+struct prehashed
+{
+	std::uint64_t low;
+	std::uint64_t high;
+
+	constexpr prehashed(std::uint64_t low = 0, std::uint64_t high = 0) : low(low), high(high)
+	{
+	}
+};
+
+static constexpr bool
+operator==(const prehashed &a, const prehashed &b)
+{
+	return a.low == b.low && a.high == b.high;
+}
+
+static constexpr bool
+operator!=(const prehashed &a, const prehashed &b)
+{
+	return !(a == b);
+}
+
+static inline std::ostream &
+operator<<(std::ostream &os, const prehashed &key)
+{
+	auto flags = os.flags();
+	os << std::hex << "0x" << key.high << ":0x" << key.low;
+	os.flags(flags);
+	return os;
+}
+
+static inline void
+emit_literal(std::ostream &os, const prehashed &key)
+{
+	auto flags = os.flags();
+	os << std::hex << "phf::prehashed(0x" << key.low << "u, 0x" << key.high << "u)";
+	os.flags(flags);
+}
+
+} // namespace phf
+
+namespace std {
+
+//
+// The hasher for the prehashed keys. The plain form serves the hash tables
+// of the builders. The seeded one gives the level hash values so it is
+// the extended hasher that the functions use by default.
+//
+template <>
+struct hash<phf::prehashed>
+{
+	using result_type = std::size_t;
+
+	static constexpr std::uint64_t multiplier = UINT64_C(0x9E3779B97F4A7C15);
+
+	std::size_t operator()(const phf::prehashed &key) const
+	{
+		return key.low ^ (key.high * multiplier);
+	}
+
+	std::size_t operator()(const phf::prehashed &key, std::uint64_t seed) const
+	{
+		return phf::bits::mix(key.low ^ (key.high * multiplier) ^ seed);
+	}
+};
+
+} // namespace std
+
+#endif // PERFECT_HASH_PREHASHED_H
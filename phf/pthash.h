@@ -0,0 +1,385 @@
+#ifndef PERFECT_HASH_PTHASH_H
+#define PERFECT_HASH_PTHASH_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+#include "bits.h"
+#include "emit.h"
+#include "hasher.h"
+#include "rng.h"
+#include "serialize.h"
+
+namespace phf {
+
+//
+// A minimal perfect hash function object based on compressed bucket
+// displacements. It follows the ideas from this paper:
+//
+// * Giulio Ermanno Pibiri, Roberto Trani.
+// PTHash: Revisiting FCH Minimal Perfect Hashing.
+//
+// The keys are split into buckets by the first hash value. Each bucket
+// has a pilot value chosen so that the second hash value of every key
+// in the bucket mixed with the pilot gives a distinct free position in
+// a table slightly larger than the key set. The positions beyond the
+// key set size are then remapped to the free positions within it.
+//
+// The pilots and the remap table are stored as packed arrays with the
+// minimal required bit width. So a lookup normally takes a single load
+// of the pilot value.
+//
+template <typename Key, typename Hash = std::hash<Key>, typename Rank = std::size_t,
+	  typename Bitset = std::vector<std::uint64_t>>
+class pthash
+{
+public:
+	using key_type = Key;
+	using rank_type = Rank;
+	using base_hasher_type = Hash;
+	using hasher_type = hasher<2, key_type, base_hasher_type>;
+	using bitset_type = Bitset;
+
+	using bitset_value_type = typename bitset_type::value_type;
+	static_assert(sizeof(bitset_value_type) == 8, "invalid value type");
+
+	static constexpr rank_type value_nbits = 8 * sizeof(bitset_value_type);
+
+	// The serialized object tag: "PTHASHF1".
+	static constexpr std::uint64_t tag = UINT64_C(0x3146485341485450);
+
+	pthash(const hasher_type &hasher, rank_type size, rank_type table_size,
+	       rank_type nbuckets, unsigned pilot_nbits, unsigned remap_nbits,
+	       bitset_type &&bitset)
+		: hasher_(hasher), size_(size), table_size_(table_size), nbuckets_(nbuckets),
+		  dense_nbuckets_(dense_buckets(nbuckets)), pilot_nbits_(pilot_nbits),
+		  remap_nbits_(remap_nbits), remap_(nbuckets * pilot_nbits),
+		  bitset_(std::move(bitset))
+	{
+		if (table_size_ == 0 || table_size_ < size_)
+			throw std::invalid_argument("table size must be no less than key set size");
+		if (nbuckets_ == 0)
+			throw std::invalid_argument("bucket number must be positive");
+		if (pilot_nbits_ > value_nbits || remap_nbits_ > value_nbits)
+			throw std::invalid_argument("invalid packed value width");
+
+		std::size_t total_nbits = remap_ + (table_size_ - size_) * remap_nbits_;
+		if (bitset_.size() * value_nbits < total_nbits)
+			throw std::invalid_argument("bitset is too small");
+	}
+
+	rank_type size() const
+	{
+		return size_;
+	}
+
+	std::size_t memory_size() const
+	{
+		return bitset_.size() * sizeof(bitset_value_type);
+	}
+
+	// The lookup never fails. For a key not from the original set it
+	// returns an arbitrary rank.
+	std::size_t operator[](const key_type &key) const
+	{
+		auto bucket = map_bucket(hasher_(key, 0), nbuckets_, dense_nbuckets_);
+		auto pilot = bits::get(bitset_, bucket * pilot_nbits_, pilot_nbits_);
+		auto position = map_position(hasher_(key, 1), pilot, table_size_);
+		if (position < size_)
+			return position;
+
+		auto offset = remap_ + (position - size_) * remap_nbits_;
+		return bits::get(bitset_, offset, remap_nbits_);
+	}
+
+	void write(std::ostream &os) const
+	{
+		io::write_tag(os, tag);
+		io::write(os, hasher_.seeds());
+		io::write(os, std::uint64_t{size_});
+		io::write(os, std::uint64_t{table_size_});
+		io::write(os, std::uint64_t{nbuckets_});
+		io::write(os, pilot_nbits_);
+		io::write(os, remap_nbits_);
+		io::write(os, bitset_);
+	}
+
+	static std::unique_ptr<pthash> read(std::istream &is)
+	{
+		typename hasher_type::seed_array_type seeds;
+		std::uint64_t size, table_size, nbuckets;
+		unsigned pilot_nbits, remap_nbits;
+		bitset_type bitset;
+
+		io::read_tag(is, tag);
+		io::read(is, seeds);
+		io::read(is, size);
+		io::read(is, table_size);
+		io::read(is, nbuckets);
+		io::read(is, pilot_nbits);
+		io::read(is, remap_nbits);
+		io::read(is, bitset);
+
+		return std::make_unique<pthash>(hasher_type(seeds), size, table_size, nbuckets,
+						pilot_nbits, remap_nbits, std::move(bitset));
+	}
+
+	void emit(std::ostream &os, const std::string &name, const std::string &key_type_name,
+		  const std::string &hasher_type_name) const
+	{
+		std::string emit_class = "phf::pthash<";
+		emit_class += key_type_name + ", " + hasher_type_name;
+		emit_class += ", std::size_t, static_bitset>";
+
+		os << "namespace " << name << " {\n\n";
+		emit_static_hasher(os, hasher_type::count, key_type_name, hasher_type_name,
+				   hasher_.seeds());
+		emit_static_bitset(os, bitset_);
+		os << "struct mph : " << emit_class << " {\n";
+		os << "\tmph() : " << emit_class << "(static_hasher, " << size_ << ", "
+		   << table_size_ << ", " << nbuckets_ << ", " << pilot_nbits_ << ", "
+		   << remap_nbits_ << ", static_bitset())"
+		   << " {\n";
+		os << "\t}\n";
+		os << "} instance;\n\n";
+		os << "} // namespace " << name << "\n\n";
+	}
+
+	// About 60% of keys go to the first 30% of buckets. Such a skewed
+	// distribution makes it easier to find pilots for the large buckets
+	// that are placed first.
+	static rank_type dense_buckets(rank_type nbuckets)
+	{
+		return nbuckets * 3 / 10;
+	}
+
+	static std::size_t map_bucket(std::uint64_t hash, rank_type nbuckets,
+				      rank_type dense_nbuckets)
+	{
+		static constexpr std::uint32_t dense_threshold = UINT32_C(2576980377);
+		if (std::uint32_t(hash) < dense_threshold && dense_nbuckets != 0)
+			return bits::reduce32(hash >> 32, dense_nbuckets);
+		return dense_nbuckets + bits::reduce32(hash >> 32, nbuckets - dense_nbuckets);
+	}
+
+	static std::size_t map_position(std::uint64_t hash, std::uint64_t pilot,
+					rank_type table_size)
+	{
+		rng::rng64 mixer(pilot);
+		return bits::reduce64(hash ^ mixer(), table_size);
+	}
+
+private:
+	hasher_type hasher_;
+
+	rank_type size_;
+	rank_type table_size_;
+	rank_type nbuckets_;
+	rank_type dense_nbuckets_;
+
+	unsigned pilot_nbits_;
+	unsigned remap_nbits_;
+
+	// The bit offset of the remap table.
+	std::size_t remap_;
+
+	bitset_type bitset_;
+};
+
+template <typename Key, typename Hash = std::hash<Key>>
+class pthash_builder
+{
+public:
+	using key_type = Key;
+	using base_hasher_type = Hash;
+	using hasher_type = hasher<2, key_type, base_hasher_type>;
+
+	using mph_type = pthash<key_type, base_hasher_type>;
+	using rank_type = typename mph_type::rank_type;
+
+	// Give up on the current seed if any pilot exceeds this limit.
+	static constexpr std::uint64_t max_pilot = UINT64_C(1) << 20;
+	// Give up the build after this many attempts with different seeds.
+	static constexpr std::size_t max_attempts = 16;
+
+	pthash_builder(double c, std::uint64_t seed, double alpha = 0.98)
+		: c_(c), alpha_(alpha), seed_(seed), hasher_(seed)
+	{
+		if (c_ <= 0)
+			throw std::invalid_argument("c must be positive");
+		if (alpha_ <= 0 || alpha_ > 1)
+			throw std::invalid_argument("alpha must be in the (0, 1] range");
+	}
+
+	void insert(const key_type &key)
+	{
+		keys_.insert(key);
+	}
+
+	std::unique_ptr<mph_type> build()
+	{
+		rng::rng128 rng(seed_);
+		for (std::size_t attempt = 0; attempt < max_attempts; attempt++) {
+			auto result = try_build();
+			if (result)
+				return result;
+#if PHF_DEBUG > 0
+			std::cerr << "pthash: retry with a new seed\n";
+#endif
+			hasher_ = hasher_type(rng());
+		}
+		throw std::runtime_error("failed to find pilots for the key set");
+	}
+
+	void clear()
+	{
+		hasher_ = hasher_type(seed_);
+		keys_.clear();
+	}
+
+private:
+	struct entry
+	{
+		std::uint64_t bucket;
+		std::uint64_t hash;
+
+		bool operator<(const entry &other) const
+		{
+			if (bucket != other.bucket)
+				return bucket < other.bucket;
+			return hash < other.hash;
+		}
+	};
+
+	std::unique_ptr<mph_type> try_build()
+	{
+		std::size_t size = keys_.size();
+		std::size_t table_size = std::ceil(size / alpha_);
+		table_size = std::max(table_size, std::max(size, std::size_t{1}));
+
+		double log_size = std::log2(std::max(size, std::size_t{2}));
+		std::size_t nbuckets = std::ceil(c_ * size / log_size);
+		nbuckets = std::max(nbuckets, std::size_t{1});
+		std::size_t dense_nbuckets = mph_type::dense_buckets(nbuckets);
+
+		// Hash the keys and group them by buckets.
+		std::vector<entry> entries;
+		entries.reserve(size);
+		for (const auto &key : keys_) {
+			auto bucket = mph_type::map_bucket(hasher_(key, 0), nbuckets,
+							   dense_nbuckets);
+			entries.push_back({bucket, hasher_(key, 1)});
+		}
+		std::sort(entries.begin(), entries.end());
+		for (std::size_t i = 1; i < entries.size(); i++) {
+			if (entries[i - 1].bucket == entries[i].bucket
+			    && entries[i - 1].hash == entries[i].hash)
+				return nullptr;
+		}
+
+		std::vector<std::size_t> starts(nbuckets + 1);
+		for (const auto &e : entries)
+			starts[e.bucket + 1]++;
+		for (std::size_t b = 0; b < nbuckets; b++)
+			starts[b + 1] += starts[b];
+
+		// Order buckets by size, the largest buckets go first.
+		std::vector<std::size_t> order(nbuckets);
+		for (std::size_t b = 0; b < nbuckets; b++)
+			order[b] = b;
+		std::stable_sort(order.begin(), order.end(), [&starts](auto x, auto y) {
+			return (starts[x + 1] - starts[x]) > (starts[y + 1] - starts[y]);
+		});
+
+		// Find a pilot for each bucket.
+		std::uint64_t pilot_max = 0;
+		std::vector<std::uint64_t> pilots(nbuckets);
+		std::vector<bool> taken(table_size);
+		std::vector<std::size_t> positions;
+		for (auto b : order) {
+			if (starts[b] == starts[b + 1])
+				break;
+
+			std::uint64_t pilot = 0;
+			for (;; pilot++) {
+				if (pilot == max_pilot)
+					return nullptr;
+				if (try_pilot(pilot, table_size, &entries[starts[b]],
+					      &entries[starts[b + 1]], taken, positions))
+					break;
+			}
+
+			for (auto position : positions)
+				taken[position] = true;
+			pilots[b] = pilot;
+			pilot_max = std::max(pilot_max, pilot);
+		}
+
+		// Pack the pilots and the remap table.
+		unsigned pilot_nbits = bits::width(pilot_max);
+		unsigned remap_nbits = bits::width(size ? size - 1 : 0);
+		std::size_t remap = nbuckets * pilot_nbits;
+		std::size_t total_nbits = remap + (table_size - size) * remap_nbits;
+
+		std::vector<std::uint64_t> bitset(bits::nwords(total_nbits));
+		for (std::size_t b = 0; b < nbuckets; b++)
+			bits::put(bitset, b * pilot_nbits, pilot_nbits, pilots[b]);
+
+		std::size_t free = 0;
+		for (std::size_t position = size; position < table_size; position++) {
+			if (!taken[position])
+				continue;
+			while (taken[free])
+				free++;
+			auto offset = remap + (position - size) * remap_nbits;
+			bits::put(bitset, offset, remap_nbits, free++);
+		}
+
+#if PHF_DEBUG > 0
+		std::cerr << "pthash: " << size << " keys, " << nbuckets << " buckets, max pilot "
+			  << pilot_max << ", " << (64.0 * bitset.size() / std::max(size, std::size_t{1}))
+			  << " bits per key\n";
+#endif
+
+		return std::make_unique<mph_type>(hasher_, size, table_size, nbuckets,
+						  pilot_nbits, remap_nbits, std::move(bitset));
+	}
+
+	bool try_pilot(std::uint64_t pilot, std::size_t table_size, const entry *begin,
+		       const entry *end, const std::vector<bool> &taken,
+		       std::vector<std::size_t> &positions)
+	{
+		positions.clear();
+		for (auto it = begin; it != end; ++it) {
+			auto position = mph_type::map_position(it->hash, pilot, table_size);
+			if (taken[position])
+				return false;
+			positions.push_back(position);
+		}
+
+		std::sort(positions.begin(), positions.end());
+		return std::adjacent_find(positions.begin(), positions.end()) == positions.end();
+	}
+
+	// The c parameter sets the average bucket size to log2(n) / c.
+	const double c_;
+	// The alpha parameter sets the ratio of the key set size to the
+	// table size.
+	const double alpha_;
+
+	const std::uint64_t seed_;
+	hasher_type hasher_;
+
+	std::unordered_set<key_type> keys_;
+};
+
+} // namespace phf
+
+#endif // PERFECT_HASH_PTHASH_H
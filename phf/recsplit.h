@@ -0,0 +1,547 @@
+#ifndef PERFECT_HASH_RECSPLIT_H
+#define PERFECT_HASH_RECSPLIT_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+#include "bits.h"
+#include "elias_fano.h"
+#include "hasher.h"
+#include "rng.h"
+#include "serialize.h"
+
+namespace phf {
+
+//
+// The shape of RecSplit splitting trees. This is shared by the builder
+// and the lookup code.
+//
+// A bucket of keys is recursively split into parts until the parts are
+// no larger than the leaf size. The keys of a leaf are then mapped to
+// distinct positions with a bijection. Each split and each bijection is
+// described by a number of attempts needed to find a suitable hash seed.
+// The numbers are stored in the Golomb-Rice code with the parameter that
+// depends on the node size. The fixed parts of the codes for a bucket
+// go first in the pre-order of the tree nodes and the unary parts go
+// after them. So a subtree might be skipped without decoding it.
+//
+class recsplit_layout
+{
+public:
+	static constexpr std::size_t max_leaf_size = 16;
+	static constexpr std::size_t max_depth = 64;
+
+	recsplit_layout(std::size_t leaf_size, const std::vector<std::uint8_t> &golomb)
+		: leaf_size_(leaf_size), golomb_(golomb)
+	{
+		if (leaf_size_ < 1 || leaf_size_ > max_leaf_size)
+			throw std::invalid_argument("invalid leaf size");
+
+		// The split strategy from the original RecSplit paper.
+		std::size_t lower_aggr = std::max(2.0, std::ceil(0.35 * leaf_size_ + 0.5));
+		std::size_t upper_aggr = std::max(2.0, std::ceil(0.21 * leaf_size_ + 0.9));
+		lower_unit_ = leaf_size_ * lower_aggr;
+		upper_unit_ = lower_unit_ * upper_aggr;
+
+		rng::rng64 rng(UINT64_C(0x243F6A8885A308D3));
+		for (auto &seed : seeds_)
+			seed = rng();
+
+		// Find the number of nodes and the size of the fixed parts
+		// of the codes for subtrees of each possible size.
+		skip_nodes_.resize(golomb_.size());
+		skip_bits_.resize(golomb_.size());
+		for (std::size_t m = 2; m < golomb_.size(); m++) {
+			skip_nodes_[m] = 1;
+			skip_bits_[m] = golomb_[m];
+			if (m <= leaf_size_)
+				continue;
+
+			std::size_t unit, fanout;
+			split(m, unit, fanout);
+			std::size_t last = m - unit * (fanout - 1);
+			skip_nodes_[m] += skip_nodes_[unit] * (fanout - 1) + skip_nodes_[last];
+			skip_bits_[m] += skip_bits_[unit] * (fanout - 1) + skip_bits_[last];
+		}
+	}
+
+	std::size_t leaf_size() const
+	{
+		return leaf_size_;
+	}
+
+	std::size_t max_size() const
+	{
+		return golomb_.size() - 1;
+	}
+
+	const std::vector<std::uint8_t> &golomb() const
+	{
+		return golomb_;
+	}
+
+	unsigned golomb(std::size_t m) const
+	{
+		return golomb_[m];
+	}
+
+	std::uint64_t seed(std::size_t level) const
+	{
+		return seeds_[level];
+	}
+
+	std::size_t skip_nodes(std::size_t m) const
+	{
+		return skip_nodes_[m];
+	}
+
+	std::size_t skip_bits(std::size_t m) const
+	{
+		return skip_bits_[m];
+	}
+
+	// Get the part size and the number of parts for a node larger than
+	// the leaf size. The last part might be smaller than the others.
+	void split(std::size_t m, std::size_t &unit, std::size_t &fanout) const
+	{
+		if (m <= lower_unit_) {
+			unit = leaf_size_;
+		} else if (m <= upper_unit_) {
+			unit = lower_unit_;
+		} else {
+			unit = ((m / 2 + upper_unit_ - 1) / upper_unit_) * upper_unit_;
+		}
+		fanout = (m + unit - 1) / unit;
+	}
+
+	// Map a key fingerprint to a node part or a leaf position.
+	std::size_t position(std::uint64_t fingerprint, std::size_t level, std::uint64_t x,
+			     std::size_t m) const
+	{
+		return bits::reduce64(bits::mix(fingerprint + seeds_[level] + x), m);
+	}
+
+	// Compute the Golomb-Rice parameters for all node sizes up to the
+	// given one.
+	static std::vector<std::uint8_t> compute_golomb(std::size_t leaf_size,
+							std::size_t max_size)
+	{
+		std::vector<std::uint8_t> golomb(max_size + 1);
+		recsplit_layout layout(leaf_size, golomb);
+		for (std::size_t m = 2; m <= max_size; m++) {
+			// Find the logarithm of the probability that a random
+			// seed gives a suitable split or bijection.
+			double log_p = std::lgamma(m + 1.0);
+			if (m <= leaf_size) {
+				log_p -= m * std::log(double(m));
+			} else {
+				std::size_t unit, fanout;
+				layout.split(m, unit, fanout);
+				std::size_t last = m - unit * (fanout - 1);
+				log_p -= (fanout - 1) * part_log(unit, m) + part_log(last, m);
+			}
+			golomb[m] = optimal_golomb(std::exp(log_p));
+		}
+		return golomb;
+	}
+
+private:
+	static double part_log(std::size_t part, std::size_t m)
+	{
+		return std::lgamma(part + 1.0) - part * std::log(double(part) / m);
+	}
+
+	// The optimal Golomb-Rice parameter for a geometric distribution
+	// with the given success probability.
+	static unsigned optimal_golomb(double p)
+	{
+		static const double golden = (1 + std::sqrt(5.0)) / 2;
+		if (p >= 1)
+			return 0;
+		double ratio = std::log(golden - 1) / std::log1p(-p);
+		if (ratio < 1)
+			return 0;
+		return std::min(1 + std::floor(std::log2(ratio)), 63.0);
+	}
+
+	std::size_t leaf_size_;
+	std::size_t lower_unit_;
+	std::size_t upper_unit_;
+
+	std::vector<std::uint8_t> golomb_;
+	std::vector<std::size_t> skip_nodes_;
+	std::vector<std::size_t> skip_bits_;
+
+	std::array<std::uint64_t, max_depth> seeds_;
+};
+
+//
+// A minimal perfect hash function object based on recursive splitting
+// as described in this paper:
+//
+// * Emmanuel Esposito, Thomas Mueller Graf, Sebastiano Vigna.
+// RecSplit: Minimal Perfect Hashing via Recursive Splitting.
+//
+// It needs about 1.6 to 2 bits per key depending on the leaf and bucket
+// sizes. The lookup is slower than with the other function objects as
+// it has to decode a path in the splitting tree of the key bucket.
+//
+template <typename Key, typename Hash = std::hash<Key>>
+class recsplit
+{
+public:
+	using key_type = Key;
+	using rank_type = std::size_t;
+	using base_hasher_type = Hash;
+	using hasher_type = hasher<2, key_type, base_hasher_type>;
+
+	static constexpr std::uint64_t tag = UINT64_C(0x3154494c50534352);
+
+	recsplit(const hasher_type &hasher, rank_type size, std::size_t nbuckets,
+		 recsplit_layout &&layout, elias_fano &&bucket_keys, elias_fano &&bucket_bits,
+		 std::vector<std::uint64_t> &&tree)
+		: hasher_(hasher), size_(size), nbuckets_(nbuckets), layout_(std::move(layout)),
+		  bucket_keys_(std::move(bucket_keys)), bucket_bits_(std::move(bucket_bits)),
+		  tree_(std::move(tree))
+	{
+		if (nbuckets_ == 0)
+			throw std::invalid_argument("bucket number must be positive");
+		if (bucket_keys_.size() != nbuckets_ + 1 || bucket_bits_.size() != nbuckets_ + 1)
+			throw std::invalid_argument("invalid bucket data");
+		if (bucket_keys_[nbuckets_] != size_)
+			throw std::invalid_argument("invalid key count");
+	}
+
+	rank_type size() const
+	{
+		return size_;
+	}
+
+	std::size_t memory_size() const
+	{
+		return bucket_keys_.memory_size() + bucket_bits_.memory_size()
+		       + tree_.size() * sizeof(std::uint64_t) + layout_.golomb().size();
+	}
+
+	// For a key not from the original set it returns an arbitrary rank
+	// or not_found.
+	std::size_t operator[](const key_type &key) const
+	{
+		auto fingerprint = hasher_(key, 0);
+		auto bucket = bits::reduce64(fingerprint, nbuckets_);
+
+		std::size_t rank = bucket_keys_[bucket];
+		std::size_t m = bucket_keys_[bucket + 1] - rank;
+		if (m <= 1)
+			return m ? rank : not_found;
+
+		std::size_t fixed = bucket_bits_[bucket];
+		std::size_t unary = fixed + layout_.skip_bits(m);
+		std::size_t leaf_size = layout_.leaf_size();
+		std::size_t level = 0;
+		while (m > leaf_size) {
+			auto x = read_code(fixed, unary, layout_.golomb(m));
+			auto part = layout_.position(fingerprint, level, x, m);
+
+			std::size_t unit, fanout;
+			layout_.split(m, unit, fanout);
+			part /= unit;
+
+			// Skip the subtrees of the preceding parts.
+			fixed += layout_.skip_bits(unit) * part;
+			unary = skip_codes(unary, layout_.skip_nodes(unit) * part);
+			rank += unit * part;
+
+			m = part == fanout - 1 ? m - unit * part : unit;
+			level++;
+		}
+		if (m > 1) {
+			auto x = read_code(fixed, unary, layout_.golomb(m));
+			rank += layout_.position(fingerprint, level, x, m);
+		}
+
+		return rank;
+	}
+
+	void write(std::ostream &os) const
+	{
+		io::write_tag(os, tag);
+		io::write(os, hasher_.seeds());
+		io::write(os, std::uint64_t{size_});
+		io::write(os, std::uint64_t{nbuckets_});
+		io::write(os, std::uint64_t{layout_.leaf_size()});
+		io::write(os, layout_.golomb());
+		bucket_keys_.write(os);
+		bucket_bits_.write(os);
+		io::write(os, tree_);
+	}
+
+	static std::unique_ptr<recsplit> read(std::istream &is)
+	{
+		typename hasher_type::seed_array_type seeds;
+		std::uint64_t size, nbuckets, leaf_size;
+		std::vector<std::uint8_t> golomb;
+		elias_fano bucket_keys, bucket_bits;
+		std::vector<std::uint64_t> tree;
+
+		io::read_tag(is, tag);
+		io::read(is, seeds);
+		io::read(is, size);
+		io::read(is, nbuckets);
+		io::read(is, leaf_size);
+		io::read(is, golomb);
+		bucket_keys.read(is);
+		bucket_bits.read(is);
+		io::read(is, tree);
+
+		return std::make_unique<recsplit>(hasher_type(seeds), size, nbuckets,
+						  recsplit_layout(leaf_size, golomb),
+						  std::move(bucket_keys), std::move(bucket_bits),
+						  std::move(tree));
+	}
+
+private:
+	std::uint64_t read_code(std::size_t &fixed, std::size_t &unary, unsigned golomb) const
+	{
+		std::uint64_t value = bits::get(tree_, fixed, golomb);
+		fixed += golomb;
+
+		std::size_t index = unary / 64;
+		std::uint64_t word = tree_[index] >> (unary % 64);
+		std::uint64_t zeros = 0;
+		if (word == 0) {
+			zeros = 64 - unary % 64;
+			while ((word = tree_[++index]) == 0)
+				zeros += 64;
+		}
+		auto shift = __builtin_ctzll(word);
+		zeros += shift;
+		unary += zeros + 1;
+
+		return (zeros << golomb) | value;
+	}
+
+	std::size_t skip_codes(std::size_t unary, std::size_t ncodes) const
+	{
+		if (ncodes == 0)
+			return unary;
+
+		std::size_t index = unary / 64;
+		std::uint64_t word = tree_[index] & ~bits::mask(unary % 64);
+		for (;;) {
+			std::size_t count = __builtin_popcountll(word);
+			if (ncodes <= count)
+				return index * 64 + bits::select(word, ncodes - 1) + 1;
+			ncodes -= count;
+			word = tree_[++index];
+		}
+	}
+
+	hasher_type hasher_;
+
+	rank_type size_;
+	std::size_t nbuckets_;
+
+	recsplit_layout layout_;
+	elias_fano bucket_keys_;
+	elias_fano bucket_bits_;
+	std::vector<std::uint64_t> tree_;
+};
+
+template <typename Key, typename Hash = std::hash<Key>>
+class recsplit_builder
+{
+public:
+	using key_type = Key;
+	using base_hasher_type = Hash;
+	using hasher_type = hasher<2, key_type, base_hasher_type>;
+
+	using mph_type = recsplit<key_type, base_hasher_type>;
+
+	// Give up the build after this many attempts with different seeds.
+	static constexpr std::size_t max_attempts = 16;
+
+	// The typical parameters are the leaf size of 8 and the bucket size
+	// of 100. Larger values give smaller functions at the cost of more
+	// expensive builds and lookups.
+	recsplit_builder(std::size_t leaf_size, std::size_t bucket_size, std::uint64_t seed)
+		: leaf_size_(leaf_size), bucket_size_(bucket_size), seed_(seed), hasher_(seed)
+	{
+		if (leaf_size_ < 1 || leaf_size_ > recsplit_layout::max_leaf_size)
+			throw std::invalid_argument("invalid leaf size");
+		if (bucket_size_ < 1)
+			throw std::invalid_argument("bucket size must be positive");
+	}
+
+	void insert(const key_type &key)
+	{
+		keys_.insert(key);
+	}
+
+	std::unique_ptr<mph_type> build()
+	{
+		rng::rng128 rng(seed_);
+		for (std::size_t attempt = 0; attempt < max_attempts; attempt++) {
+			auto result = try_build();
+			if (result)
+				return result;
+#if PHF_DEBUG > 0
+			std::cerr << "recsplit: retry with a new seed\n";
+#endif
+			hasher_ = hasher_type(rng());
+		}
+		throw std::runtime_error("failed to find distinct key fingerprints");
+	}
+
+	void clear()
+	{
+		hasher_ = hasher_type(seed_);
+		keys_.clear();
+	}
+
+private:
+	std::unique_ptr<mph_type> try_build()
+	{
+		std::size_t size = keys_.size();
+		std::size_t nbuckets = std::max((size + bucket_size_ - 1) / bucket_size_,
+						std::size_t{1});
+
+		// The bucket index is monotone in the fingerprint value so
+		// sorting the fingerprints groups them by buckets.
+		std::vector<std::uint64_t> fingerprints;
+		fingerprints.reserve(size);
+		for (const auto &key : keys_)
+			fingerprints.push_back(hasher_(key, 0));
+		std::sort(fingerprints.begin(), fingerprints.end());
+		if (std::adjacent_find(fingerprints.begin(), fingerprints.end())
+		    != fingerprints.end())
+			return nullptr;
+
+		std::vector<std::uint64_t> bucket_keys(nbuckets + 1);
+		for (auto fingerprint : fingerprints)
+			bucket_keys[bits::reduce64(fingerprint, nbuckets) + 1]++;
+		std::size_t max_bucket_size = 1;
+		for (std::size_t b = 0; b < nbuckets; b++) {
+			max_bucket_size = std::max(max_bucket_size, bucket_keys[b + 1]);
+			bucket_keys[b + 1] += bucket_keys[b];
+		}
+
+		recsplit_layout layout(leaf_size_, recsplit_layout::compute_golomb(
+							   leaf_size_, max_bucket_size));
+
+		bits::writer tree;
+		std::vector<std::uint64_t> bucket_bits(nbuckets + 1);
+		std::vector<std::uint64_t> buffer(max_bucket_size);
+		for (std::size_t b = 0; b < nbuckets; b++) {
+			fixed_.clear();
+			unary_.clear();
+			split(layout, &fingerprints[bucket_keys[b]],
+			      bucket_keys[b + 1] - bucket_keys[b], 0, buffer.data());
+			tree.append(fixed_);
+			tree.append(unary_);
+			bucket_bits[b + 1] = tree.size();
+		}
+
+#if PHF_DEBUG > 0
+		std::cerr << "recsplit: " << size << " keys, " << nbuckets << " buckets, "
+			  << (double(tree.size()) / std::max(size, std::size_t{1}))
+			  << " tree bits per key\n";
+#endif
+
+		return std::make_unique<mph_type>(hasher_, size, nbuckets, std::move(layout),
+						  elias_fano(bucket_keys), elias_fano(bucket_bits),
+						  std::move(tree.words()));
+	}
+
+	void split(const recsplit_layout &layout, std::uint64_t *fingerprints, std::size_t m,
+		   std::size_t level, std::uint64_t *buffer)
+	{
+		if (m <= 1)
+			return;
+		if (level == recsplit_layout::max_depth)
+			throw std::runtime_error("too deep splitting tree");
+
+		if (m <= leaf_size_) {
+			// Find a bijection for the leaf keys.
+			std::uint64_t full = bits::mask(m);
+			for (std::uint64_t x = 0;; x++) {
+				std::uint64_t mask = 0;
+				for (std::size_t i = 0; i < m; i++) {
+					auto position = layout.position(fingerprints[i], level, x, m);
+					mask |= UINT64_C(1) << position;
+				}
+				if (mask == full) {
+					append_code(x, layout.golomb(m));
+					return;
+				}
+			}
+		}
+
+		std::size_t unit, fanout;
+		layout.split(m, unit, fanout);
+
+		std::array<std::size_t, 2 * recsplit_layout::max_leaf_size> counts;
+		for (std::uint64_t x = 0;; x++) {
+			std::fill_n(counts.begin(), fanout, 0);
+			for (std::size_t i = 0; i < m; i++)
+				counts[layout.position(fingerprints[i], level, x, m) / unit]++;
+
+			bool found = true;
+			for (std::size_t part = 0; part < fanout - 1; part++) {
+				if (counts[part] != unit) {
+					found = false;
+					break;
+				}
+			}
+			if (!found)
+				continue;
+
+			append_code(x, layout.golomb(m));
+
+			// Group the keys by the parts.
+			std::size_t offsets[2 * recsplit_layout::max_leaf_size];
+			for (std::size_t part = 0; part < fanout; part++)
+				offsets[part] = part * unit;
+			for (std::size_t i = 0; i < m; i++) {
+				auto part = layout.position(fingerprints[i], level, x, m) / unit;
+				buffer[offsets[part]++] = fingerprints[i];
+			}
+			std::copy(buffer, buffer + m, fingerprints);
+			break;
+		}
+
+		for (std::size_t part = 0; part < fanout; part++) {
+			std::size_t part_size = part == fanout - 1 ? m - unit * part : unit;
+			split(layout, fingerprints + unit * part, part_size, level + 1, buffer);
+		}
+	}
+
+	void append_code(std::uint64_t x, unsigned golomb)
+	{
+		fixed_.append(x, golomb);
+		unary_.append_unary(x >> golomb);
+	}
+
+	const std::size_t leaf_size_;
+	const std::size_t bucket_size_;
+
+	const std::uint64_t seed_;
+	hasher_type hasher_;
+
+	std::unordered_set<key_type> keys_;
+
+	// The Golomb-Rice codes for the current bucket.
+	bits::writer fixed_;
+	bits::writer unary_;
+};
+
+} // namespace phf
+
+#endif // PERFECT_HASH_RECSPLIT_H
@@ -0,0 +1,417 @@
+#ifndef PERFECT_HASH_RETRIEVAL_H
+#define PERFECT_HASH_RETRIEVAL_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "bits.h"
+#include "hasher.h"
+#include "rng.h"
+#include "serialize.h"
+
+namespace phf {
+
+//
+// The slot array layout of a retrieval data structure that maps 64-bit
+// hash values to r-bit values using a 3-wise binary fuse graph as
+// described in this paper:
+//
+// * Thomas Mueller Graf, Daniel Lemire.
+// Binary Fuse Filters: Fast and Smaller Than Xor Filters.
+//
+// Each hash value selects three slots in consecutive segments of the
+// slot array and the value is the XOR of these slots. So a lookup takes
+// three loads from a small window of the array. With large sets the
+// slot array takes about 1.125 * r bits per key.
+//
+// The slots are packed into a word array at the given bit offset so a
+// few structures might share a single array.
+//
+class fuse_layout
+{
+public:
+	static constexpr unsigned arity = 3;
+	static constexpr std::uint64_t max_segment_length = 1 << 18;
+
+	fuse_layout() = default;
+
+	fuse_layout(std::size_t size, unsigned value_nbits) : size_(size), value_nbits_(value_nbits)
+	{
+		if (value_nbits == 0 || value_nbits > 64)
+			throw std::invalid_argument("invalid value size");
+		init_layout(size);
+	}
+
+	std::size_t size() const
+	{
+		return size_;
+	}
+
+	unsigned value_nbits() const
+	{
+		return value_nbits_;
+	}
+
+	// The size of the slot array in bits.
+	std::size_t nbits() const
+	{
+		return array_length_ * value_nbits_;
+	}
+
+	//
+	// Assign the slots for the given hash and value pairs. It fails and
+	// returns false if the hash graph cannot be peeled. This normally
+	// happens only if there are duplicate hash values. In this case the
+	// hash values should be recomputed with a different seed. The slot
+	// bits are expected to be clear.
+	//
+	template <typename Words>
+	bool assign(const std::vector<std::pair<std::uint64_t, std::uint64_t>> &items, Words &words,
+		    std::size_t offset) const
+	{
+		if (items.size() != size_)
+			throw std::invalid_argument("item number mismatch");
+
+		// Count the hash values in each slot and accumulate XORs of
+		// their item indices and of their position numbers (0, 1 or 2)
+		// within the hash triple.
+		std::vector<std::uint32_t> counts(array_length_);
+		std::vector<std::uint64_t> indices(array_length_);
+		for (std::size_t i = 0; i < size_; i++) {
+			std::uint64_t slots[arity];
+			positions(items[i].first, slots);
+			for (unsigned j = 0; j < arity; j++) {
+				counts[slots[j]] += 4;
+				counts[slots[j]] ^= j;
+				indices[slots[j]] ^= i;
+			}
+		}
+
+		// Peel the slots with a single hash value.
+		std::vector<std::uint64_t> queue;
+		for (std::uint64_t s = 0; s < array_length_; s++) {
+			if ((counts[s] >> 2) == 1)
+				queue.push_back(s);
+		}
+		std::vector<std::pair<std::uint64_t, std::uint64_t>> stack;
+		stack.reserve(size_);
+		while (!queue.empty()) {
+			auto s = queue.back();
+			queue.pop_back();
+			if ((counts[s] >> 2) != 1)
+				continue;
+
+			auto i = indices[s];
+			unsigned found = counts[s] & 3;
+			stack.emplace_back(i, found);
+
+			std::uint64_t slots[arity];
+			positions(items[i].first, slots);
+			for (unsigned j = 0; j < arity; j++) {
+				if (j == found)
+					continue;
+				auto t = slots[j];
+				counts[t] -= 4;
+				counts[t] ^= j;
+				indices[t] ^= i;
+				if ((counts[t] >> 2) == 1)
+					queue.push_back(t);
+			}
+			counts[s] = 0;
+		}
+		if (stack.size() != size_)
+			return false;
+
+		// Assign the slots in the reverse peeling order.
+		for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+			const auto &item = items[it->first];
+			std::uint64_t slots[arity];
+			positions(item.first, slots);
+
+			auto value = item.second & bits::mask(value_nbits_);
+			for (unsigned j = 0; j < arity; j++) {
+				if (j != it->second)
+					value ^= get(words, offset, slots[j]);
+			}
+			bits::put(words, offset + slots[it->second] * value_nbits_, value_nbits_,
+				  value);
+		}
+		return true;
+	}
+
+	template <typename Words>
+	std::uint64_t lookup(const Words &words, std::size_t offset, std::uint64_t hash) const
+	{
+		std::uint64_t slots[arity];
+		positions(hash, slots);
+		return get(words, offset, slots[0]) ^ get(words, offset, slots[1])
+		       ^ get(words, offset, slots[2]);
+	}
+
+private:
+	std::size_t size_ = 0;
+	unsigned value_nbits_ = 0;
+
+	std::uint64_t segment_length_ = 0;
+	std::uint64_t segment_mask_ = 0;
+	std::uint64_t segment_count_length_ = 0;
+	std::uint64_t array_length_ = 0;
+
+	// Choose the segment length and the array length for the given set
+	// size as suggested by the paper.
+	void init_layout(std::size_t size)
+	{
+		double n = size;
+		if (size == 0) {
+			segment_length_ = 4;
+		} else {
+			auto shift = std::floor(std::log(n) / std::log(3.33) + 2.25);
+			segment_length_ = std::uint64_t{1} << std::max(int(shift), 0);
+		}
+		segment_length_ = std::min(segment_length_, std::uint64_t{max_segment_length});
+		segment_mask_ = segment_length_ - 1;
+
+		double factor = 0;
+		if (size > 1)
+			factor = std::max(1.125, 0.875 + 0.25 * std::log(1e6) / std::log(n));
+		auto capacity = std::int64_t(std::round(n * factor));
+
+		std::int64_t length = segment_length_;
+		std::int64_t segment_count = (capacity + length - 1) / length - (arity - 1);
+		std::int64_t array_length = (segment_count + arity - 1) * length;
+		segment_count = (array_length + length - 1) / length;
+		segment_count = segment_count <= arity - 1 ? 1 : segment_count - (arity - 1);
+
+		segment_count_length_ = segment_count * length;
+		array_length_ = (segment_count + arity - 1) * length;
+	}
+
+	void positions(std::uint64_t hash, std::uint64_t *slots) const
+	{
+		auto h0 = bits::reduce64(hash, segment_count_length_);
+		auto h1 = h0 + segment_length_;
+		auto h2 = h1 + segment_length_;
+		slots[0] = h0;
+		slots[1] = h1 ^ ((hash >> 18) & segment_mask_);
+		slots[2] = h2 ^ (hash & segment_mask_);
+	}
+
+	template <typename Words>
+	std::uint64_t get(const Words &words, std::size_t offset, std::uint64_t slot) const
+	{
+		return bits::get(words, offset + slot * value_nbits_, value_nbits_);
+	}
+};
+
+//
+// A retrieval data structure with its own slot array. The value for a
+// hash not in the set is arbitrary.
+//
+class fuse_retrieval
+{
+public:
+	fuse_retrieval() = default;
+
+	//
+	// Build the structure for the given hash and value pairs. It fails
+	// and returns false if the hash graph cannot be peeled.
+	//
+	bool build(const std::vector<std::pair<std::uint64_t, std::uint64_t>> &items,
+		   unsigned value_nbits)
+	{
+		layout_ = fuse_layout(items.size(), value_nbits);
+		slots_.assign(bits::nwords(layout_.nbits()), 0);
+		return layout_.assign(items, slots_, 0);
+	}
+
+	std::uint64_t operator()(std::uint64_t hash) const
+	{
+		return layout_.lookup(slots_, 0, hash);
+	}
+
+	std::size_t size() const
+	{
+		return layout_.size();
+	}
+
+	unsigned value_nbits() const
+	{
+		return layout_.value_nbits();
+	}
+
+	std::size_t memory_size() const
+	{
+		return slots_.size() * sizeof(std::uint64_t);
+	}
+
+	void write(std::ostream &os) const
+	{
+		io::write(os, std::uint64_t{layout_.size()});
+		io::write(os, layout_.value_nbits());
+		io::write(os, slots_);
+	}
+
+	void read(std::istream &is)
+	{
+		std::uint64_t size;
+		unsigned value_nbits;
+		io::read(is, size);
+		io::read(is, value_nbits);
+		io::read(is, slots_);
+		if (value_nbits == 0 || value_nbits > 64)
+			throw std::runtime_error("invalid serialized value size");
+
+		layout_ = fuse_layout(size, value_nbits);
+		if (slots_.size() != bits::nwords(layout_.nbits()))
+			throw std::runtime_error("invalid serialized slot array size");
+	}
+
+private:
+	fuse_layout layout_;
+	std::vector<std::uint64_t> slots_;
+};
+
+//
+// A static function that maps each key of the set to an r-bit value in
+// about 1.125 * r bits per key without storing the keys. The result for
+// a key out of the set is arbitrary.
+//
+template <typename Key, typename Hash = std::hash<Key>>
+class static_function
+{
+public:
+	using key_type = Key;
+	using base_hasher_type = Hash;
+	using hasher_type = hasher<1, key_type, base_hasher_type>;
+
+	// The serialized object tag: "STATFUN1".
+	static constexpr std::uint64_t tag = UINT64_C(0x314e554654415453);
+
+	static_function(const hasher_type &hasher, fuse_retrieval &&fuse)
+		: hasher_(hasher), fuse_(std::move(fuse))
+	{
+	}
+
+	// Compute the 64-bit hash value that selects the slots. The base
+	// hash value is mixed as a non-extended hasher might leave the low
+	// bits poorly distributed.
+	static std::uint64_t hash(const hasher_type &hasher, const key_type &key)
+	{
+		return bits::mix(hasher(key, 0));
+	}
+
+	std::uint64_t operator[](const key_type &key) const
+	{
+		return fuse_(hash(hasher_, key));
+	}
+
+	std::size_t size() const
+	{
+		return fuse_.size();
+	}
+
+	unsigned value_nbits() const
+	{
+		return fuse_.value_nbits();
+	}
+
+	std::size_t memory_size() const
+	{
+		return fuse_.memory_size();
+	}
+
+	void write(std::ostream &os) const
+	{
+		io::write_tag(os, tag);
+		io::write(os, hasher_.seeds());
+		fuse_.write(os);
+	}
+
+	static std::unique_ptr<static_function> read(std::istream &is)
+	{
+		typename hasher_type::seed_array_type seeds;
+		fuse_retrieval fuse;
+		io::read_tag(is, tag);
+		io::read(is, seeds);
+		fuse.read(is);
+		return std::make_unique<static_function>(hasher_type(seeds), std::move(fuse));
+	}
+
+private:
+	hasher_type hasher_;
+	fuse_retrieval fuse_;
+};
+
+template <typename Key, typename Hash = std::hash<Key>>
+class static_function_builder
+{
+public:
+	using key_type = Key;
+	using base_hasher_type = Hash;
+	using function_type = static_function<key_type, base_hasher_type>;
+	using hasher_type = typename function_type::hasher_type;
+
+	// Give up the build after this many attempts with different seeds.
+	static constexpr std::size_t max_attempts = 16;
+
+	static_function_builder(unsigned value_nbits, std::uint64_t seed)
+		: value_nbits_(value_nbits), seed_(seed), hasher_(seed)
+	{
+		if (value_nbits_ == 0 || value_nbits_ > 64)
+			throw std::invalid_argument("invalid value size");
+	}
+
+	// Insert a key value pair. The value of a repeated key replaces
+	// the previous one. Only the low value_nbits of the value are kept.
+	void insert(const key_type &key, std::uint64_t value)
+	{
+		values_[key] = value;
+	}
+
+	std::unique_ptr<function_type> build()
+	{
+		std::vector<std::pair<std::uint64_t, std::uint64_t>> items;
+		items.reserve(values_.size());
+
+		rng::rng128 rng(seed_);
+		for (std::size_t attempt = 0; attempt < max_attempts; attempt++) {
+			items.clear();
+			for (const auto &item : values_)
+				items.emplace_back(function_type::hash(hasher_, item.first),
+						   item.second);
+
+			fuse_retrieval fuse;
+			if (fuse.build(items, value_nbits_))
+				return std::make_unique<function_type>(hasher_, std::move(fuse));
+#if PHF_DEBUG > 0
+			std::cerr << "static_function: retry with a new seed\n";
+#endif
+			hasher_ = hasher_type(rng());
+		}
+		throw std::runtime_error("failed to build the static function");
+	}
+
+	void clear()
+	{
+		hasher_ = hasher_type(seed_);
+		values_.clear();
+	}
+
+private:
+	const unsigned value_nbits_;
+	const std::uint64_t seed_;
+	hasher_type hasher_;
+
+	std::unordered_map<key_type, std::uint64_t> values_;
+};
+
+} // namespace phf
+
+#endif // PERFECT_HASH_RETRIEVAL_H
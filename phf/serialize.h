@@ -0,0 +1,141 @@
+#ifndef PERFECT_HASH_SERIALIZE_H
+#define PERFECT_HASH_SERIALIZE_H
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace phf {
+namespace io {
+
+//
+// Helpers for the binary serialized form of the hash function objects.
+// The data is written in the native byte order so it is only portable
+// between hosts of the same architecture.
+//
+
+static inline void
+check(const std::ios &stream)
+{
+	if (!stream)
+		throw std::runtime_error("serialization stream failure");
+}
+
+template <typename T>
+void
+write(std::ostream &os, const T &value)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "invalid value type");
+	os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+	check(os);
+}
+
+template <typename T>
+void
+read(std::istream &is, T &value)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "invalid value type");
+	is.read(reinterpret_cast<char *>(&value), sizeof(T));
+	check(is);
+}
+
+template <typename C, typename T, typename A>
+void
+write(std::ostream &os, const std::basic_string<C, T, A> &string)
+{
+	write(os, std::uint64_t{string.size()});
+	os.write(reinterpret_cast<const char *>(string.data()), string.size() * sizeof(C));
+	check(os);
+}
+
+template <typename C, typename T, typename A>
+void
+read(std::istream &is, std::basic_string<C, T, A> &string)
+{
+	std::uint64_t size;
+	read(is, size);
+	string.resize(size);
+	is.read(reinterpret_cast<char *>(&string[0]), size * sizeof(C));
+	check(is);
+}
+
+//
+// Vectors of trivially copyable values are written as a whole, other
+// vectors are written element by element.
+//
+
+template <typename T, typename A>
+void
+write_items(std::ostream &os, const std::vector<T, A> &vector, std::true_type)
+{
+	os.write(reinterpret_cast<const char *>(vector.data()), vector.size() * sizeof(T));
+	check(os);
+}
+
+template <typename T, typename A>
+void
+write_items(std::ostream &os, const std::vector<T, A> &vector, std::false_type)
+{
+	for (const auto &item : vector)
+		write(os, item);
+}
+
+template <typename T, typename A>
+void
+read_items(std::istream &is, std::vector<T, A> &vector, std::true_type)
+{
+	is.read(reinterpret_cast<char *>(vector.data()), vector.size() * sizeof(T));
+	check(is);
+}
+
+template <typename T, typename A>
+void
+read_items(std::istream &is, std::vector<T, A> &vector, std::false_type)
+{
+	for (auto &item : vector)
+		read(is, item);
+}
+
+template <typename T, typename A>
+void
+write(std::ostream &os, const std::vector<T, A> &vector)
+{
+	write(os, std::uint64_t{vector.size()});
+	write_items(os, vector, std::is_trivially_copyable<T>{});
+}
+
+template <typename T, typename A>
+void
+read(std::istream &is, std::vector<T, A> &vector)
+{
+	std::uint64_t size;
+	read(is, size);
+	vector.resize(size);
+	read_items(is, vector, std::is_trivially_copyable<T>{});
+}
+
+//
+// Every serialized object starts with a tag that identifies its type.
+//
+static inline void
+write_tag(std::ostream &os, std::uint64_t tag)
+{
+	write(os, tag);
+}
+
+static inline void
+read_tag(std::istream &is, std::uint64_t tag)
+{
+	std::uint64_t value;
+	read(is, value);
+	if (value != tag)
+		throw std::runtime_error("unexpected serialized object type");
+}
+
+} // namespace io
+} // namespace phf
+
+#endif // PERFECT_HASH_SERIALIZE_H
@@ -0,0 +1,211 @@
+#ifndef PERFECT_HASH_TABLE_HANDLE_H
+#define PERFECT_HASH_TABLE_HANDLE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace phf {
+
+//
+// A handle for a table object such as a hash function that might be
+// replaced with a new one while other threads use it.
+//
+// The old table is reclaimed with quiescent state based reclamation. Each
+// reader thread registers a reader object. A reader gets the current
+// table with a single atomic load and from time to time announces that
+// it holds no table pointers by calling quiescent(). A writer publishes
+// a new table and then waits until every online reader passes through a
+// quiescent state before it deletes the old one. So the read path takes
+// no locks and does no atomic read-modify-write operations.
+//
+// A reader that might not reach a quiescent state for a long time, for
+// instance while it waits for input, should go offline to avoid holding
+// the writers.
+//
+// A reader stores its epoch and then loads the table pointer while a
+// writer stores the pointer and then loads the reader epoch. Without a
+// full fence on both sides each load might be done before the other
+// thread's store becomes visible, as the stores wait in the store buffer.
+// Then the reader gets the old table and the writer sees the old epoch
+// and deletes the table under the reader. So a reader puts a seq_cst
+// fence after its epoch store and a writer puts one after the epoch
+// increment.
+//
+template <typename Table>
+class table_handle
+{
+	// The last epoch seen by a reader or zero for an offline reader. It
+	// is padded to a cache line to avoid false sharing. The slots are
+	// shared with the writers so a reader might go away while a writer
+	// waits for it.
+	struct slot
+	{
+		std::atomic<std::uint64_t> epoch{0};
+		char padding[64 - sizeof(std::atomic<std::uint64_t>)];
+	};
+
+public:
+	using table_type = Table;
+
+	class reader
+	{
+	public:
+		explicit reader(table_handle &handle)
+			: handle_(handle), slot_(std::make_shared<slot>())
+		{
+			slot_->epoch.store(handle_.epoch_.load(std::memory_order_acquire),
+					   std::memory_order_release);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			std::lock_guard<std::mutex> lock(handle_.readers_mutex_);
+			handle_.readers_.push_back(slot_);
+		}
+
+		~reader()
+		{
+			offline();
+			std::lock_guard<std::mutex> lock(handle_.readers_mutex_);
+			auto &readers = handle_.readers_;
+			readers.erase(std::find(readers.begin(), readers.end(), slot_));
+		}
+
+		reader(const reader &) = delete;
+		reader &operator=(const reader &) = delete;
+
+		// Get the current table. The pointer is valid until the next
+		// quiescent state of this reader.
+		const table_type *get() const
+		{
+			return handle_.table_.load(std::memory_order_acquire);
+		}
+
+		const table_type *operator->() const
+		{
+			return get();
+		}
+
+		const table_type &operator*() const
+		{
+			return *get();
+		}
+
+		// Announce that no table pointers obtained before are used.
+		// The fence keeps the following table loads after the store.
+		void quiescent()
+		{
+			slot_->epoch.store(handle_.epoch_.load(std::memory_order_acquire),
+					   std::memory_order_release);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+
+		// Stop and resume using the table for a long time.
+		void offline()
+		{
+			slot_->epoch.store(0, std::memory_order_release);
+		}
+
+		void online()
+		{
+			quiescent();
+		}
+
+	private:
+		table_handle &handle_;
+		std::shared_ptr<slot> slot_;
+	};
+
+	explicit table_handle(std::unique_ptr<table_type> table = nullptr)
+		: table_(table.release())
+	{
+	}
+
+	// All the readers must be gone by now.
+	~table_handle()
+	{
+		delete table_.load(std::memory_order_relaxed);
+	}
+
+	table_handle(const table_handle &) = delete;
+	table_handle &operator=(const table_handle &) = delete;
+
+	// Replace the current table with a new one. The old one is deleted
+	// when the readers are done with it. This must not be called from
+	// an online reader thread or it will wait forever.
+	void publish(std::unique_ptr<table_type> table)
+	{
+		std::lock_guard<std::mutex> lock(writer_mutex_);
+		auto old = exchange(std::move(table));
+		synchronize();
+	}
+
+	// Replace the current table without waiting for the readers. The
+	// old table is returned and must be kept until a synchronize() call
+	// made after this one returns. The callers order their exchanges.
+	std::unique_ptr<const table_type> exchange(std::unique_ptr<table_type> table)
+	{
+		return std::unique_ptr<const table_type>(
+			table_.exchange(table.release(), std::memory_order_acq_rel));
+	}
+
+	// Load a table from a file in the binary serialized form and publish
+	// it. On failure the current table is kept and an exception is thrown.
+	void load(const std::string &path)
+	{
+		load(path, [](std::istream &is) { return table_type::read(is); });
+	}
+
+	template <typename Reader>
+	void load(const std::string &path, Reader read)
+	{
+		std::ifstream file(path, std::ios::in | std::ios::binary);
+		if (!file)
+			throw std::runtime_error("failed to open " + path);
+		std::unique_ptr<table_type> table = read(file);
+		publish(std::move(table));
+	}
+
+	// Wait until all the online readers pass through a quiescent state.
+	// The wait is done on a snapshot of the reader list so the readers
+	// might come and go meanwhile. A reader registered after the snapshot
+	// already sees the new table.
+	void synchronize()
+	{
+		auto target = epoch_.fetch_add(1, std::memory_order_acq_rel) + 1;
+		// Order the table replacement and the increment before the scan
+		// of the reader epochs.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		std::vector<std::shared_ptr<slot>> readers;
+		{
+			std::lock_guard<std::mutex> lock(readers_mutex_);
+			readers = readers_;
+		}
+		for (const auto &slot : readers) {
+			for (;;) {
+				auto epoch = slot->epoch.load(std::memory_order_acquire);
+				if (epoch == 0 || epoch >= target)
+					break;
+				std::this_thread::yield();
+			}
+		}
+	}
+
+private:
+	std::atomic<const table_type *> table_;
+	std::atomic<std::uint64_t> epoch_{1};
+
+	std::mutex writer_mutex_;
+	std::mutex readers_mutex_;
+	std::vector<std::shared_ptr<slot>> readers_;
+};
+
+} // namespace phf
+
+#endif // PERFECT_HASH_TABLE_HANDLE_H
@@ -0,0 +1,205 @@
+#ifndef PERFECT_HASH_TINY_H
+#define PERFECT_HASH_TINY_H
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+#include "emit.h"
+#include "hasher.h"
+#include "rng.h"
+#include "serialize.h"
+
+namespace phf {
+
+//
+// A minimal perfect hash function object for tiny key sets of up to 64
+// keys. The hash seed is chosen so that the high bits of the hash values
+// of all the keys are distinct. The key rank is then the number of keys
+// with smaller values that is found with a single popcount on a word of
+// their bits. So a lookup is a hash, a shift and a popcount with no rank
+// directory or other tables.
+//
+// Up to about 32 keys fit a single 64-bit word. For larger sets a seed
+// for a single word is hard to find so two or four words are used along
+// with the rank counts at the start of each word.
+//
+template <typename Key, typename Hash = std::hash<Key>>
+class tiny_mph
+{
+public:
+	using key_type = Key;
+	using base_hasher_type = Hash;
+	using hasher_type = hasher<2, key_type, base_hasher_type>;
+
+	static_assert(sizeof(typename hasher_type::result_type) == 8, "invalid hash value type");
+
+	// The serialized object tag: "TINYMPH1".
+	static constexpr std::uint64_t tag = UINT64_C(0x3148504d594e4954);
+
+	static constexpr std::size_t max_size = 64;
+	static constexpr std::size_t max_nwords = 4;
+
+	tiny_mph(const hasher_type &hasher, unsigned nwords, const std::uint64_t (&words)[max_nwords])
+		: hasher_(hasher), shift_(0), words_{}, ranks_{}
+	{
+		if (nwords != 1 && nwords != 2 && nwords != max_nwords)
+			throw std::invalid_argument("invalid word number");
+		shift_ = 64 - 6 - (nwords == 1 ? 0 : nwords == 2 ? 1 : 2);
+
+		unsigned rank = 0;
+		for (unsigned i = 0; i < nwords; i++) {
+			words_[i] = words[i];
+			ranks_[i] = rank;
+			rank += __builtin_popcountll(words[i]);
+		}
+		size_ = rank;
+	}
+
+	std::size_t size() const
+	{
+		return size_;
+	}
+
+	unsigned nwords() const
+	{
+		return 1u << (64 - 6 - shift_);
+	}
+
+	std::size_t memory_size() const
+	{
+		return sizeof(*this);
+	}
+
+	// The lookup never fails. For a key not from the original set it
+	// returns an arbitrary rank.
+	std::size_t operator[](const key_type &key) const
+	{
+		std::uint64_t position = hasher_(key, 0) >> shift_;
+		auto index = position / 64;
+		auto mask = (UINT64_C(1) << (position % 64)) - 1;
+		return ranks_[index] + __builtin_popcountll(words_[index] & mask);
+	}
+
+	void emit(std::ostream &os, const std::string &name, const std::string &key_type_name,
+		  const std::string &hasher_type_name) const
+	{
+		std::string emit_class = "phf::tiny_mph<" + key_type_name + ", " + hasher_type_name
+					 + ">";
+
+		os << "namespace " << name << " {\n\n";
+		emit_static_hasher(os, hasher_type::count, key_type_name, hasher_type_name,
+				   hasher_.seeds());
+		os << "struct mph : " << emit_class << " {\n";
+		os << "\tmph() : " << emit_class << "(static_hasher, " << nwords()
+		   << ", {0x" << std::hex;
+		for (std::size_t i = 0; i < max_nwords; i++)
+			os << words_[i] << (i + 1 < max_nwords ? ", 0x" : "");
+		os << std::dec << "})"
+		   << " {\n";
+		os << "\t}\n";
+		os << "} instance;\n\n";
+		os << "} // namespace " << name << "\n\n";
+	}
+
+	void write(std::ostream &os) const
+	{
+		io::write_tag(os, tag);
+		io::write(os, hasher_.seeds());
+		io::write(os, nwords());
+		io::write(os, words_);
+	}
+
+	static std::unique_ptr<tiny_mph> read(std::istream &is)
+	{
+		typename hasher_type::seed_array_type seeds;
+		unsigned nwords;
+		std::uint64_t words[max_nwords];
+		io::read_tag(is, tag);
+		io::read(is, seeds);
+		io::read(is, nwords);
+		io::read(is, words);
+		return std::make_unique<tiny_mph>(hasher_type(seeds), nwords, words);
+	}
+
+private:
+	hasher_type hasher_;
+	unsigned shift_;
+	std::size_t size_;
+	std::uint64_t words_[max_nwords];
+	std::uint8_t ranks_[max_nwords];
+};
+
+template <typename Key, typename Hash = std::hash<Key>>
+class tiny_builder
+{
+public:
+	using key_type = Key;
+	using base_hasher_type = Hash;
+	using mph_type = tiny_mph<key_type, base_hasher_type>;
+	using hasher_type = typename mph_type::hasher_type;
+
+	// The number of seeds tried for each word number.
+	static constexpr std::size_t max_attempts = 1 << 16;
+
+	explicit tiny_builder(std::uint64_t seed) : seed_(seed)
+	{
+	}
+
+	void insert(const key_type &key)
+	{
+		if (keys_.size() == mph_type::max_size && !keys_.count(key))
+			throw std::invalid_argument("too many keys for a tiny set");
+		keys_.insert(key);
+	}
+
+	//
+	// Find a seed that maps the keys to distinct positions. Fewer words
+	// are tried first so the result takes a single word if possible.
+	//
+	std::unique_ptr<mph_type> build()
+	{
+		rng::rng128 rng(seed_);
+		for (unsigned nwords = 1; nwords <= mph_type::max_nwords; nwords *= 2) {
+			unsigned shift = 64 - 6 - (nwords == 1 ? 0 : nwords == 2 ? 1 : 2);
+			for (std::size_t attempt = 0; attempt < max_attempts; attempt++) {
+				hasher_type hasher(typename hasher_type::seed_array_type{{rng()}});
+
+				std::uint64_t words[mph_type::max_nwords] = {0};
+				bool ok = true;
+				for (const auto &key : keys_) {
+					std::uint64_t position = hasher(key, 0) >> shift;
+					auto mask = UINT64_C(1) << (position % 64);
+					if ((words[position / 64] & mask) != 0) {
+						ok = false;
+						break;
+					}
+					words[position / 64] |= mask;
+				}
+				if (ok)
+					return std::make_unique<mph_type>(hasher, nwords, words);
+			}
+#if PHF_DEBUG > 0
+			std::cerr << "tiny_mph: no seed for " << nwords << " words\n";
+#endif
+		}
+		throw std::runtime_error("failed to find a seed for the key set");
+	}
+
+	void clear()
+	{
+		keys_.clear();
+	}
+
+private:
+	const std::uint64_t seed_;
+
+	std::unordered_set<key_type> keys_;
+};
+
+} // namespace phf
+
+#endif // PERFECT_HASH_TINY_H